@@ -0,0 +1,346 @@
+// Compares the pointer-based AST with its flat form: bytes per node, the time of a walk
+// following the structure of each, and the time of lowering to IR from each, where the flat
+// side pays for flattening the tree first. Exits with 1 if the two give different IR.
+
+#include <chrono>
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t, std::stoul
+#include <iostream>
+#include <memory> // std::unique_ptr
+#include <string>
+#include <variant> // std::visit
+#include <vector>
+
+#include "error.h"
+#include "flat_ast.h"
+#include "ir.h"
+#include "ir_builder.h"
+#include "parser.h"
+#include "random_program.h"
+#include "tokenizer.h"
+#include "tree_ir_builder.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Helper type for the visitor
+template<typename... Ts>
+struct Visitor : Ts... {
+    using Ts::operator()...;
+};
+
+// Nodes of the pointer-based tree, and the bytes of their structs and vectors
+struct TreeSize {
+    size_t nodes{};
+    size_t bytes{};
+
+    template <typename T>
+    void add(const T *const) {
+        ++nodes;
+        bytes += sizeof(T);
+    }
+};
+
+// Sums the literals, the name lengths and the node kinds, so every node is read
+struct Walk {
+    uint64_t sum{};
+};
+
+void measureExpr(const NodeExpr *const expr, TreeSize &size) {
+    size.add(expr);
+    std::visit(Visitor{
+        [&size](const NodeTerm *const term) {
+            size.add(term);
+            std::visit(Visitor{
+                [&size](const NodeTermParen *const parenTerm) {
+                    size.add(parenTerm);
+                    measureExpr(parenTerm->expr, size);
+                },
+                [&size](const auto *const leaf) {
+                    size.add(leaf);
+                },
+            }, term->term);
+        },
+        [&size](const NodeBinExpr *const binExpr) {
+            size.add(binExpr);
+            std::visit([&size](const auto *const bin) {
+                size.add(bin);
+                measureExpr(bin->lhs, size);
+                measureExpr(bin->rhs, size);
+            }, binExpr->expr);
+        },
+    }, expr->expr);
+}
+
+void measureScope(const NodeScope *const scope, TreeSize &size);
+
+void measureStmt(const NodeStmt *const stmt, TreeSize &size) {
+    size.add(stmt);
+    std::visit(Visitor{
+        [&size](const NodeStmtExit *const exitStmt) {
+            size.add(exitStmt);
+            measureExpr(exitStmt->expr, size);
+        },
+        [&size](const NodeStmtLet *const letStmt) {
+            size.add(letStmt);
+            measureExpr(letStmt->expr, size);
+        },
+        [&size](const NodeStmtAssign *const assignStmt) {
+            size.add(assignStmt);
+            measureExpr(assignStmt->expr, size);
+        },
+        [&size](const NodeStmtIf *const ifStmt) {
+            size.add(ifStmt);
+            size.bytes += ifStmt->elifBranches.capacity() * sizeof(const NodeBranchElif *);
+            size.add(ifStmt->ifBranch);
+            measureExpr(ifStmt->ifBranch->expr, size);
+            measureScope(ifStmt->ifBranch->scope, size);
+            for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
+                size.add(elifBranch);
+                measureExpr(elifBranch->expr, size);
+                measureScope(elifBranch->scope, size);
+            }
+            if (ifStmt->elseBranch) {
+                size.add(ifStmt->elseBranch);
+                measureScope(ifStmt->elseBranch->scope, size);
+            }
+        },
+        [&size](const NodeStmtWhile *const whileStmt) {
+            size.add(whileStmt);
+            measureExpr(whileStmt->expr, size);
+            measureScope(whileStmt->scope, size);
+        },
+        [&size](const NodeScope *const scope) {
+            measureScope(scope, size);
+        },
+    }, stmt->stmt);
+}
+
+void measureScope(const NodeScope *const scope, TreeSize &size) {
+    size.add(scope);
+    size.bytes += scope->stmts.capacity() * sizeof(const NodeStmt *);
+    for (const NodeStmt *const stmt : scope->stmts) {
+        measureStmt(stmt, size);
+    }
+}
+
+void walkExpr(const NodeExpr *const expr, Walk &walk) {
+    std::visit(Visitor{
+        [&walk](const NodeTerm *const term) {
+            std::visit(Visitor{
+                [&walk](const NodeTermIntLiteral *const intLiteralTerm) {
+                    walk.sum += intLiteralTerm->value;
+                },
+                [&walk](const NodeTermIdentifier *const identifierTerm) {
+                    walk.sum += identifierTerm->identifier.name.size();
+                },
+                [&walk](const NodeTermParen *const parenTerm) {
+                    walk.sum += 2;
+                    walkExpr(parenTerm->expr, walk);
+                },
+            }, term->term);
+        },
+        [&walk](const NodeBinExpr *const binExpr) {
+            walk.sum += 3 + binExpr->expr.index();
+            std::visit([&walk](const auto *const bin) {
+                walkExpr(bin->lhs, walk);
+                walkExpr(bin->rhs, walk);
+            }, binExpr->expr);
+        },
+    }, expr->expr);
+}
+
+void walkScope(const NodeScope *const scope, Walk &walk);
+
+void walkStmt(const NodeStmt *const stmt, Walk &walk) {
+    std::visit(Visitor{
+        [&walk](const NodeStmtExit *const exitStmt) {
+            walkExpr(exitStmt->expr, walk);
+        },
+        [&walk](const NodeStmtLet *const letStmt) {
+            walk.sum += letStmt->identifier.name.size();
+            walkExpr(letStmt->expr, walk);
+        },
+        [&walk](const NodeStmtAssign *const assignStmt) {
+            walk.sum += assignStmt->identifier.name.size();
+            walkExpr(assignStmt->expr, walk);
+        },
+        [&walk](const NodeStmtIf *const ifStmt) {
+            walkExpr(ifStmt->ifBranch->expr, walk);
+            walkScope(ifStmt->ifBranch->scope, walk);
+            for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
+                walkExpr(elifBranch->expr, walk);
+                walkScope(elifBranch->scope, walk);
+            }
+            if (ifStmt->elseBranch) {
+                walkScope(ifStmt->elseBranch->scope, walk);
+            }
+        },
+        [&walk](const NodeStmtWhile *const whileStmt) {
+            walkExpr(whileStmt->expr, walk);
+            walkScope(whileStmt->scope, walk);
+        },
+        [&walk](const NodeScope *const scope) {
+            walkScope(scope, walk);
+        },
+    }, stmt->stmt);
+}
+
+void walkScope(const NodeScope *const scope, Walk &walk) {
+    for (const NodeStmt *const stmt : scope->stmts) {
+        walkStmt(stmt, walk);
+    }
+}
+
+// The same walk over the flat form, from each node to its children
+void walkFlat(const FlatAst &ast, const NodeIndex index, Walk &walk) {
+    const FlatNode &node{ ast[index] };
+    switch (node.kind) {
+    case NodeKind::INT_LITERAL:
+        walk.sum += ast.literals[node.a];
+        break;
+    case NodeKind::IDENTIFIER:
+        walk.sum += ast.names[node.a].size();
+        break;
+    case NodeKind::PAREN:
+        walk.sum += 2;
+        walkFlat(ast, node.a, walk);
+        break;
+    case NodeKind::ADD:
+    case NodeKind::SUB:
+    case NodeKind::MUL:
+    case NodeKind::DIV:
+        walk.sum += 3 + static_cast<size_t>(node.kind) - static_cast<size_t>(NodeKind::ADD);
+        walkFlat(ast, node.a, walk);
+        walkFlat(ast, node.b, walk);
+        break;
+    case NodeKind::EXIT:
+        walkFlat(ast, node.a, walk);
+        break;
+    case NodeKind::LET:
+    case NodeKind::ASSIGN:
+        walk.sum += ast.names[node.a].size();
+        walkFlat(ast, node.b, walk);
+        break;
+    case NodeKind::WHILE:
+        walkFlat(ast, node.a, walk);
+        walkFlat(ast, node.b, walk);
+        break;
+    case NodeKind::IF:
+    case NodeKind::SCOPE:
+    case NodeKind::PROG:
+        for (NodeIndex i{ 0 }; i < node.b; ++i) {
+            walkFlat(ast, ast.childrenOf(node)[i], walk);
+        }
+        break;
+    }
+}
+
+double milliseconds(const Clock::time_point start, const size_t repeats) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / repeats;
+}
+
+int main(int argc, char **argv) {
+    const size_t progCount{ argc > 1 ? std::stoul(argv[1]) : 50 };
+    const size_t stmtCount{ argc > 2 ? std::stoul(argv[2]) : 400 };
+    const size_t repeats{ argc > 3 ? std::stoul(argv[3]) : 5 };
+
+    RandomProgram generator{ 42 };
+    std::vector<std::string> sources{}; // keep the sources and the trees viewing them alive
+    sources.reserve(progCount);
+    std::vector<std::unique_ptr<Parser>> parsers{};
+    std::vector<const NodeProg *> progs{};
+    std::vector<FlatAst> flatAsts{};
+    TreeSize treeSize{};
+    size_t flatNodes{};
+    size_t flatBytes{};
+    for (size_t i{ 0 }; i < progCount; ++i) {
+        sources.push_back(generator.generate(stmtCount));
+        Tokenizer tokenizer{ sources.back() };
+        parsers.push_back(std::make_unique<Parser>(tokenizer.tokenize()));
+        progs.push_back(parsers.back()->parseProg());
+
+        treeSize.add(progs.back());
+        treeSize.bytes += progs.back()->stmts.capacity() * sizeof(const NodeStmt *);
+        for (const NodeStmt *const stmt : progs.back()->stmts) {
+            measureStmt(stmt, treeSize);
+        }
+
+        AstFlattener flattener{};
+        flatAsts.push_back(flattener.flatten(progs.back()));
+        flatNodes += flatAsts.back().nodes.size();
+        flatBytes += flatAsts.back().bytes();
+    }
+
+    size_t irBlocks{};
+    for (size_t i{ 0 }; i < progCount; ++i) {
+        TreeIrBuilder treeBuilder{};
+        IrBuilder flatBuilder{};
+        const IrFunction ir{ flatBuilder.build(flatAsts[i]) };
+        if (to_string(treeBuilder.build(progs[i])) != to_string(ir)) {
+            error("The IR lowered from the flat form of program " + std::to_string(i) + " differs");
+        }
+        irBlocks += ir.blocks.size();
+    }
+
+    Walk treeWalk{};
+    Clock::time_point start{ Clock::now() };
+    for (size_t r{ 0 }; r < repeats; ++r) {
+        for (const NodeProg *const prog : progs) {
+            for (const NodeStmt *const stmt : prog->stmts) {
+                walkStmt(stmt, treeWalk);
+            }
+        }
+    }
+    const double treeWalkMs{ milliseconds(start, repeats) };
+
+    Walk flatWalk{};
+    start = Clock::now();
+    for (size_t r{ 0 }; r < repeats; ++r) {
+        for (const FlatAst &ast : flatAsts) {
+            walkFlat(ast, ast.root(), flatWalk);
+        }
+    }
+    const double flatWalkMs{ milliseconds(start, repeats) };
+
+    // lowering, counting the blocks so the IR isn't optimized away
+    size_t blocks{};
+    start = Clock::now();
+    for (size_t r{ 0 }; r < repeats; ++r) {
+        for (const NodeProg *const prog : progs) {
+            TreeIrBuilder builder{};
+            blocks += builder.build(prog).blocks.size();
+        }
+    }
+    const double treeLowerMs{ milliseconds(start, repeats) };
+
+    double flattenMs{};
+    double flatLowerMs{};
+    for (size_t r{ 0 }; r < repeats; ++r) {
+        for (const NodeProg *const prog : progs) {
+            const Clock::time_point flattenStart{ Clock::now() };
+            AstFlattener flattener{};
+            const FlatAst ast{ flattener.flatten(prog) };
+            const Clock::time_point lowerStart{ Clock::now() };
+            IrBuilder builder{};
+            blocks += builder.build(ast).blocks.size();
+            flattenMs += std::chrono::duration<double, std::milli>(lowerStart - flattenStart).count();
+            flatLowerMs += std::chrono::duration<double, std::milli>(Clock::now() - lowerStart).count();
+        }
+    }
+    flattenMs /= repeats;
+    flatLowerMs /= repeats;
+    if (blocks != 2 * repeats * irBlocks) {
+        error("Lowering gave different IR on a repeat");
+    }
+
+    // Per node of the flat form, which has one for each syntactic element
+    std::cout << flatNodes << " nodes, " << irBlocks << " IR blocks\n";
+    std::cout << "pointer tree: " << treeSize.nodes << " structs, "
+        << static_cast<double>(treeSize.bytes) / flatNodes << " bytes per node; walk "
+        << treeWalkMs << " ms (sum " << treeWalk.sum << "); lowering " << treeLowerMs << " ms\n";
+    std::cout << "flat: " << static_cast<double>(flatBytes) / flatNodes << " bytes per node; walk "
+        << flatWalkMs << " ms (sum " << flatWalk.sum << "); flattening " << flattenMs << " ms + lowering "
+        << flatLowerMs << " ms = " << flattenMs + flatLowerMs << " ms\n";
+
+    return 0;
+}
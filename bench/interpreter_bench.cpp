@@ -0,0 +1,106 @@
+// Compares the bytecode interpreter against native code run through the JIT:
+// both backends compile and execute the same random programs, results must agree.
+
+#include <chrono>
+#include <cstdint> // int64_t
+#include <cstdlib> // size_t, std::stoul
+#include <iostream>
+#include <memory> // std::unique_ptr
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "error.h"
+#include "generator.h"
+#include "interpreter.h"
+#include "ir_builder.h"
+#include "jit.h"
+#include "parser.h"
+#include "pass_manager.h"
+#include "random_program.h"
+#include "tokenizer.h"
+#include "x86_encoder.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Timing {
+    double compile{}; // seconds
+    double run{};
+};
+
+double since(const Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int64_t interpret(const NodeProg *const prog, Timing &timing) {
+    const Clock::time_point start{ Clock::now() };
+    BytecodeCompiler compiler{};
+    const Bytecode bytecode{ compiler.compileProg(prog) };
+    Interpreter interpreter{ bytecode };
+    timing.compile += since(start);
+
+    const Clock::time_point runStart{ Clock::now() };
+    const int64_t result{ interpreter.run() };
+    timing.run += since(runStart);
+
+    return result;
+}
+
+int64_t runNative(const NodeProg *const prog, Timing &timing) {
+    const Clock::time_point start{ Clock::now() };
+    IrBuilder irBuilder{};
+    IrFunction ir{ irBuilder.build(prog) };
+    PassManager passManager{};
+    passManager.run(ir);
+    Generator generator{ ExitMode::RETURN };
+    X86Encoder encoder{};
+    const JitFunction program{ encoder.encode(generator.genProg(ir)) };
+    timing.compile += since(start);
+
+    const Clock::time_point runStart{ Clock::now() };
+    const int64_t result{ program() };
+    timing.run += since(runStart);
+
+    return result;
+}
+
+void report(const std::string &name, const Timing &timing, const size_t progCount) {
+    const double total{ timing.compile + timing.run };
+    std::cout << name << ": "
+        << timing.compile * 1e6 / progCount << " us compile + "
+        << timing.run * 1e6 / progCount << " us run per program, "
+        << progCount / total << " programs/s\n";
+}
+
+int main(int argc, char **argv) {
+    const size_t progCount{ argc > 1 ? std::stoul(argv[1]) : 2000 };
+    const size_t stmtCount{ argc > 2 ? std::stoul(argv[2]) : 20 };
+
+    RandomProgram generator{ 42 };
+    std::vector<std::string> sources{}; // keep the sources and the ASTs viewing them alive
+    sources.reserve(progCount);
+    std::vector<std::unique_ptr<Parser>> parsers{};
+    std::vector<const NodeProg *> progs{};
+    size_t sourceBytes{};
+    for (size_t i{ 0 }; i < progCount; ++i) {
+        sources.push_back(generator.generate(stmtCount));
+        sourceBytes += sources.back().size();
+        Tokenizer tokenizer{ sources.back() };
+        parsers.push_back(std::make_unique<Parser>(tokenizer.tokenize()));
+        progs.push_back(parsers.back()->parseProg());
+    }
+
+    Timing interpreterTiming{};
+    Timing nativeTiming{};
+    for (size_t i{ 0 }; i < progCount; ++i) {
+        if (interpret(progs[i], interpreterTiming) != runNative(progs[i], nativeTiming)) {
+            error("Mismatch on program " + std::to_string(i));
+        }
+    }
+
+    std::cout << progCount << " programs, " << sourceBytes / progCount << " bytes of source on average\n";
+    report("interpreter", interpreterTiming, progCount);
+    report("native (JIT)", nativeTiming, progCount);
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+// Measures tokenizer throughput and the memory the token stream takes on a large random program.
+
+#include <chrono>
+#include <cstdlib> // size_t, std::stoul
+#include <iostream>
+#include <string>
+
+#include "random_program.h"
+#include "tokenizer.h"
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char **argv) {
+    const size_t stmtCount{ argc > 1 ? std::stoul(argv[1]) : 20000 };
+    const size_t repeats{ argc > 2 ? std::stoul(argv[2]) : 10 };
+
+    RandomProgram generator{ 42 };
+    const std::string source{ generator.generate(stmtCount) };
+
+    size_t tokenCount{};
+    size_t streamBytes{};
+    double seconds{};
+    for (size_t i{ 0 }; i < repeats; ++i) {
+        const Clock::time_point start{ Clock::now() };
+        Tokenizer tokenizer{ source };
+        const TokenStream tokens{ tokenizer.tokenize() };
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        tokenCount = tokens.size();
+        streamBytes = tokens.bytes();
+    }
+
+    std::cout << source.size() << " bytes of source, " << tokenCount << " tokens\n"
+        << "token: " << sizeof(Token) << " bytes, stream: "
+        << static_cast<double>(streamBytes) / tokenCount << " bytes per token\n"
+        << "throughput: " << source.size() * repeats / seconds / 1e6 << " MB/s, "
+        << tokenCount * repeats / seconds / 1e6 << " Mtokens/s\n";
+
+    return 0;
+}
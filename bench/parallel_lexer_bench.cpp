@@ -0,0 +1,52 @@
+// Tokenizes a large random program on 1 to N threads, checks the tokens match the serial
+// tokenizer's and reports how the time scales.
+
+#include <algorithm> // std::max
+#include <chrono>
+#include <cstdlib> // size_t, std::stoul
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "error.h"
+#include "parallel_tokenizer.h"
+#include "random_program.h"
+#include "tokenizer.h"
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char **argv) {
+    const size_t stmtCount{ argc > 1 ? std::stoul(argv[1]) : 40000 };
+    const size_t maxThreads{ argc > 2 ? std::stoul(argv[2]) : std::max<size_t>(std::thread::hardware_concurrency(), 4) };
+    const size_t repeats{ argc > 3 ? std::stoul(argv[3]) : 5 };
+
+    RandomProgram generator{ 42 };
+    const std::string source{ generator.generate(stmtCount) };
+
+    Tokenizer serial{ source };
+    const TokenStream expected{ serial.tokenize() };
+    std::cout << source.size() / 1e6 << " MB of source, " << expected.size() << " tokens, "
+        << std::thread::hardware_concurrency() << " cores\n";
+
+    double baseline{};
+    for (size_t threads{ 1 }; threads <= maxThreads; ++threads) {
+        double seconds{};
+        for (size_t i{ 0 }; i < repeats; ++i) {
+            const Clock::time_point start{ Clock::now() };
+            const ParallelTokenizer tokenizer{ source, threads };
+            const TokenStream tokens{ tokenizer.tokenize() };
+            seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            if (tokens != expected) {
+                error("Tokens on " + std::to_string(threads) + " threads differ from serial ones");
+            }
+        }
+        seconds /= repeats;
+        if (threads == 1) {
+            baseline = seconds;
+        }
+        std::cout << threads << " threads: " << seconds * 1e3 << " ms, "
+            << source.size() / seconds / 1e6 << " MB/s, speedup " << baseline / seconds << "\n";
+    }
+
+    return 0;
+}
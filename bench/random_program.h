@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t
+#include <random>
+#include <string>
+#include <vector>
+
+// Generates random, well-formed programs for benchmarks. Divisors are non-zero literals,
+// so every program terminates normally.
+class RandomProgram {
+public:
+    RandomProgram(const RandomProgram &) = delete;
+    RandomProgram &operator=(const RandomProgram &) = delete;
+
+    explicit RandomProgram(const uint64_t seed) : mRng{ seed } {}
+
+    [[nodiscard]] std::string generate(const size_t stmtCount) {
+        mSource.clear();
+        mVars.clear();
+        mVarCount = 0;
+        for (size_t i{ 0 }; i < stmtCount; ++i) {
+            genStmt(0);
+        }
+        genIndent(0);
+        mSource += "exit(" + genExpr(2) + ");\n";
+
+        return mSource;
+    }
+
+private:
+    static constexpr size_t MAX_NESTING{ 3 };
+
+    size_t pick(const size_t n) {
+        return std::uniform_int_distribution<size_t>{ 0, n - 1 }(mRng);
+    }
+
+    void genIndent(const size_t depth) {
+        mSource.append(4 * depth, ' ');
+    }
+
+    std::string genExpr(const size_t depth) {
+        if (depth == 0 || pick(3) == 0) {
+            if (!mVars.empty() && pick(2) == 0) {
+                return mVars[pick(mVars.size())];
+            }
+            return std::to_string(pick(100));
+        }
+
+        static constexpr const char *OPS[]{ " + ", " - ", " * " };
+        switch (pick(5)) {
+        case 0:
+            return "(" + genExpr(depth - 1) + ")";
+        case 1:
+            return genExpr(depth - 1) + " / " + std::to_string(1 + pick(9));
+        default:
+            return genExpr(depth - 1) + OPS[pick(3)] + genExpr(depth - 1);
+        }
+    }
+
+    void genScope(const size_t depth) {
+        const size_t varCount{ mVars.size() };
+        mSource += "{\n";
+        const size_t stmtCount{ 1 + pick(4) };
+        for (size_t i{ 0 }; i < stmtCount; ++i) {
+            genStmt(depth + 1);
+        }
+        genIndent(depth);
+        mSource += "}";
+        mVars.resize(varCount);
+    }
+
+    void genStmt(const size_t depth) {
+        genIndent(depth);
+        const size_t kind{ depth < MAX_NESTING ? pick(10) : pick(6) };
+        if (kind < 3 || mVars.empty()) {
+            const std::string name{ "v" + std::to_string(mVarCount++) };
+            mSource += "let " + name + " = " + genExpr(3) + ";\n";
+            mVars.push_back(name);
+        } else if (kind < 6) {
+            mSource += mVars[pick(mVars.size())] + " = " + genExpr(3) + ";\n";
+        } else if (kind < 9) {
+            mSource += "if (" + genExpr(2) + ") ";
+            genScope(depth);
+            for (size_t i{ pick(3) }; i > 0; --i) {
+                mSource += " elif (" + genExpr(2) + ") ";
+                genScope(depth);
+            }
+            if (pick(2) == 0) {
+                mSource += " else ";
+                genScope(depth);
+            }
+            mSource += "\n";
+        } else {
+            genScope(depth);
+            mSource += "\n";
+        }
+    }
+
+    std::mt19937_64 mRng;
+    std::string mSource{};
+    std::vector<std::string> mVars{};
+    size_t mVarCount{};
+};
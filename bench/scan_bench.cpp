@@ -0,0 +1,64 @@
+// Tokenizes large synthetic inputs with every scan kernel set the CPU supports, checks that
+// they all produce the tokens of the scalar one and reports the throughput of each.
+
+#include <chrono>
+#include <cstdlib> // size_t, std::stoul
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "random_program.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Long names, deep indentation and comments: the runs the kernels are for
+std::string wideSource(const size_t lineCount) {
+    std::mt19937_64 rng{ 7 };
+    std::string source{};
+    for (size_t i{ 0 }; i < lineCount; ++i) {
+        source.append(4 * (rng() % 8), ' ');
+        const std::string name{ "variable" + std::string(rng() % 24, 'x') + std::to_string(i) };
+        source += "let " + name + " = " + std::to_string(rng()) + " * " + std::to_string(rng() % 1000) + ";";
+        if (rng() % 3 == 0) {
+            source += "\t# " + std::string(rng() % 80, 'c') + "\n";
+        } else {
+            source += "\n";
+        }
+    }
+    return source;
+}
+
+void measure(const std::string &name, const std::string &source, const size_t repeats) {
+    std::cout << name << ": " << source.size() / 1e6 << " MB\n";
+
+    Tokenizer reference{ source, SCALAR_KERNELS };
+    const TokenStream expected{ reference.tokenize() };
+    for (const ScanKernels *const kernels : supportedKernels()) {
+        double seconds{};
+        for (size_t i{ 0 }; i < repeats; ++i) {
+            const Clock::time_point start{ Clock::now() };
+            Tokenizer tokenizer{ source, *kernels };
+            const TokenStream tokens{ tokenizer.tokenize() };
+            seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            if (tokens != expected) {
+                error(std::string(kernels->name) + " tokens differ from scalar ones");
+            }
+        }
+        std::cout << "    " << kernels->name << ": " << source.size() * repeats / seconds / 1e9 << " GB/s\n";
+    }
+}
+
+int main(int argc, char **argv) {
+    const size_t lineCount{ argc > 1 ? std::stoul(argv[1]) : 1000000 };
+    const size_t repeats{ argc > 2 ? std::stoul(argv[2]) : 5 };
+
+    RandomProgram generator{ 42 };
+    measure("random program", generator.generate(lineCount / 50), repeats);
+    measure("wide lines", wideSource(lineCount), repeats);
+
+    return 0;
+}
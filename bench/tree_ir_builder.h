@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm> // std::max
+#include <cstdlib> // size_t
+#include <optional>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility> // std::move, std::pair
+#include <variant> // std::visit
+#include <vector>
+
+#include "error.h"
+#include "ir.h"
+#include "parser.h"
+
+// The IR builder as it was before it lowered from the flat AST: the same lowering, by
+// visiting the pointer-based tree. Kept for ast_bench to time the flat form against and to
+// check that both give the same IR.
+class TreeIrBuilder {
+public:
+    TreeIrBuilder(const TreeIrBuilder &) = delete;
+    TreeIrBuilder &operator=(const TreeIrBuilder &) = delete;
+
+    TreeIrBuilder() = default;
+
+    [[nodiscard]] IrFunction build(const NodeProg *const prog) {
+        mCurrent = newBlock();
+        for (const NodeStmt *const stmt : prog->stmts) {
+            lowerStmt(stmt);
+        }
+
+        // Exit with zero if no `exit` statement
+        terminate({ .kind = IrTerm::Kind::EXIT, .value = IrOperand::i(0) });
+
+        removeUnreachableBlocks(mFn);
+        return std::move(mFn);
+    }
+
+private:
+    // Helper type for the visitor
+    template<typename... Ts>
+    struct Visitor : Ts... {
+        using Ts::operator()...;
+    };
+
+    static std::pair<const NodeExpr *, const NodeExpr *> operands(const NodeBinExpr *const binExpr) {
+        return std::visit([](const auto *const bin) {
+            return std::pair<const NodeExpr *, const NodeExpr *>{ bin->lhs, bin->rhs };
+        }, binExpr->expr);
+    }
+
+    static IrOp irOp(const NodeBinExpr *const binExpr) {
+        return std::visit(Visitor{
+            [](const NodeBinExprAdd *const) { return IrOp::ADD; },
+            [](const NodeBinExprSub *const) { return IrOp::SUB; },
+            [](const NodeBinExprMul *const) { return IrOp::MUL; },
+            [](const NodeBinExprDiv *const) { return IrOp::DIV; },
+        }, binExpr->expr);
+    }
+
+    // Sethi-Ullman (Ershov) number counting temporaries; variables and literals need none
+    size_t labelExpr(const NodeExpr *const expr) {
+        const size_t need{ std::visit(Visitor{
+
+            [this](const NodeTerm *const term) -> size_t {
+                if (const auto *const parenTerm{ std::get_if<const NodeTermParen *>(&term->term) }) {
+                    return labelExpr((*parenTerm)->expr);
+                }
+                return 0;
+            },
+
+            [this](const NodeBinExpr *const binExpr) -> size_t {
+                const auto [lhs, rhs]{ operands(binExpr) };
+                const size_t lhsNeed{ labelExpr(lhs) };
+                const size_t rhsNeed{ labelExpr(rhs) };
+                return lhsNeed == rhsNeed ? lhsNeed + 1 : std::max(lhsNeed, rhsNeed);
+            },
+
+        }, expr->expr) };
+
+        mRegNeeds[expr] = need;
+        return need;
+    }
+
+    IrOperand lowerTerm(const NodeTerm *const term) {
+        return std::visit(Visitor{
+
+            [](const NodeTermIntLiteral *const intLiteralTerm) {
+                return IrOperand::i(intLiteralTerm->value);
+            },
+
+            [this](const NodeTermIdentifier *const identifierTerm) {
+                const auto it{ mVars.find(identifierTerm->identifier.name) };
+                if (it == mVars.cend()) {
+                    error("Undeclared variable: " + std::string{ identifierTerm->identifier.name });
+                }
+                return IrOperand::v(it->second);
+            },
+
+            [this](const NodeTermParen *const parenTerm) {
+                return lowerExpr(parenTerm->expr, std::nullopt);
+            },
+
+        }, term->term);
+    }
+
+    // The operand that needs more temporaries is lowered first, which keeps fewer of them live
+    IrOperand lowerBinExpr(const NodeBinExpr *const binExpr, const std::optional<Vreg> dst) {
+        const auto [lhs, rhs]{ operands(binExpr) };
+        IrOperand a{};
+        IrOperand b{};
+        if (mRegNeeds.at(rhs) > mRegNeeds.at(lhs)) {
+            b = lowerExpr(rhs, std::nullopt);
+            a = lowerExpr(lhs, std::nullopt);
+        } else {
+            a = lowerExpr(lhs, std::nullopt);
+            b = lowerExpr(rhs, std::nullopt);
+        }
+
+        const Vreg result{ dst ? *dst : mFn.newVreg() };
+        emit({ .op = irOp(binExpr), .dst = result, .a = a, .b = b });
+        return IrOperand::v(result);
+    }
+
+    // Lowers the expression, into `dst` if given
+    IrOperand lowerExpr(const NodeExpr *const expr, const std::optional<Vreg> dst) {
+        return std::visit(Visitor{
+
+            [this, dst](const NodeTerm *const term) {
+                const IrOperand value{ lowerTerm(term) };
+                if (!dst) {
+                    return value;
+                }
+                emit({ .op = IrOp::COPY, .dst = *dst, .a = value });
+                return IrOperand::v(*dst);
+            },
+
+            [this, dst](const NodeBinExpr *const binExpr) {
+                return lowerBinExpr(binExpr, dst);
+            },
+
+        }, expr->expr);
+    }
+
+    // Lowers a full expression tree
+    IrOperand lowerFullExpr(const NodeExpr *const expr, const std::optional<Vreg> dst) {
+        mRegNeeds.clear();
+        labelExpr(expr);
+        return lowerExpr(expr, dst);
+    }
+
+    void lowerScope(const NodeScope *const scope) {
+        mScopes.push(mVars.size());
+        for (const NodeStmt *const stmt : scope->stmts) {
+            lowerStmt(stmt);
+        }
+        const size_t popCount{ mVars.size() - mScopes.top() };
+        for (size_t i{ 0 }; i < popCount; ++i) {
+            mVars.erase(mVarOrder.top());
+            mVarOrder.pop();
+        }
+        mScopes.pop();
+    }
+
+    // Branches on the condition into a new block with the scope, which then jumps to the block
+    // recorded in `exits`; lowering carries on in the block taken when the condition is zero
+    void lowerConditionAndScope(const NodeExpr *const condExpr, const NodeScope *const scope, std::vector<size_t> &exits) {
+        mLine = lineOf(condExpr);
+        const IrOperand cond{ lowerFullExpr(condExpr, std::nullopt) };
+        const size_t thenBlock{ newBlock() };
+        const size_t elseBlock{ newBlock() };
+        terminate({ .kind = IrTerm::Kind::BRANCH, .value = cond, .target = thenBlock, .elseTarget = elseBlock });
+
+        mCurrent = thenBlock;
+        lowerScope(scope);
+        exits.push_back(mCurrent);
+        terminate({ .kind = IrTerm::Kind::JMP });
+
+        mCurrent = elseBlock;
+    }
+
+    void lowerStmt(const NodeStmt *const stmt) {
+        std::visit(Visitor{
+
+            [this](const NodeStmtExit *const exitStmt) {
+                mLine = lineOf(exitStmt->expr);
+                const IrOperand value{ lowerFullExpr(exitStmt->expr, std::nullopt) };
+                terminate({ .kind = IrTerm::Kind::EXIT, .value = value });
+                mCurrent = newBlock(); // unreachable, dropped at the end
+            },
+
+            [this](const NodeStmtLet *const letStmt) {
+                const std::string_view name{ letStmt->identifier.name };
+                if (mVars.contains(name)) {
+                    error("Identifier already used: " + std::string{ name });
+                }
+                mLine = letStmt->identifier.ln;
+                const Vreg var{ mFn.newVreg() };
+                lowerFullExpr(letStmt->expr, var); // the initializer can't see the new variable
+                mVars[name] = var;
+                mVarOrder.push(name);
+            },
+
+            [this](const NodeStmtAssign *const assignStmt) {
+                const auto it{ mVars.find(assignStmt->identifier.name) };
+                if (it == mVars.cend()) {
+                    error("Undeclared identifier: " + std::string{ assignStmt->identifier.name });
+                }
+                mLine = assignStmt->identifier.ln;
+                lowerFullExpr(assignStmt->expr, it->second);
+            },
+
+            [this](const NodeStmtIf *const ifStmt) {
+                std::vector<size_t> exits{};
+                lowerConditionAndScope(ifStmt->ifBranch->expr, ifStmt->ifBranch->scope, exits);
+                for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
+                    lowerConditionAndScope(elifBranch->expr, elifBranch->scope, exits);
+                }
+                if (ifStmt->elseBranch) {
+                    lowerScope(ifStmt->elseBranch->scope);
+                }
+                exits.push_back(mCurrent);
+                terminate({ .kind = IrTerm::Kind::JMP });
+
+                const size_t endBlock{ newBlock() };
+                for (const size_t exit : exits) {
+                    mFn.blocks[exit].term.target = endBlock;
+                }
+                mCurrent = endBlock;
+            },
+
+            // The header checks the condition; the body jumps back to it
+            [this](const NodeStmtWhile *const whileStmt) {
+                const size_t headerBlock{ newBlock() };
+                terminate({ .kind = IrTerm::Kind::JMP, .target = headerBlock });
+
+                mCurrent = headerBlock;
+                mLine = lineOf(whileStmt->expr);
+                const IrOperand cond{ lowerFullExpr(whileStmt->expr, std::nullopt) };
+                const size_t bodyBlock{ newBlock() };
+                const size_t exitBlock{ newBlock() };
+                terminate({ .kind = IrTerm::Kind::BRANCH, .value = cond, .target = bodyBlock, .elseTarget = exitBlock });
+
+                mCurrent = bodyBlock;
+                lowerScope(whileStmt->scope);
+                terminate({ .kind = IrTerm::Kind::JMP, .target = headerBlock });
+
+                mCurrent = exitBlock;
+            },
+
+            [this](const NodeScope *const scope) {
+                lowerScope(scope);
+            },
+
+        }, stmt->stmt);
+    }
+
+    size_t newBlock() {
+        mFn.blocks.emplace_back();
+        return mFn.blocks.size() - 1;
+    }
+
+    void emit(const IrInstr &instr) {
+        mFn.blocks[mCurrent].instrs.push_back(instr);
+        mFn.blocks[mCurrent].instrs.back().line = mLine;
+    }
+
+    void terminate(const IrTerm &term) {
+        mFn.blocks[mCurrent].term = term;
+        mFn.blocks[mCurrent].term.line = mLine;
+    }
+
+    IrFunction mFn{};
+    size_t mCurrent{};
+    int mLine{}; // of the statement being lowered
+    std::unordered_map<const NodeExpr *, size_t> mRegNeeds{};
+    std::unordered_map<std::string_view, Vreg> mVars{};
+    std::stack<std::string_view, std::vector<std::string_view>> mVarOrder{};
+    std::stack<size_t, std::vector<size_t>> mScopes{};
+};
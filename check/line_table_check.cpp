@@ -0,0 +1,161 @@
+// Checks the mapping from code to source lines: the regions lineRegions makes of line
+// entries, then the `.symtab` regions and `.debug_line` rows of a sample compiled with and
+// without optimizations, read back with readelf and addr2line. Exits with 1 on the first
+// mismatch.
+//
+// Usage: line_table_check <compile> <work directory>
+
+#include <cstdio> // popen, pclose, fgets
+#include <cstdlib> // size_t
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "line_table.h"
+
+constexpr char SAMPLE_NAME[]{ "sample.code" };
+
+// Every statement on a line of its own; lines 1 and 2 only reach the code as the copies
+// into the loop's registers once the values are propagated
+constexpr char SAMPLE[]{
+    "let a = 3;\n"
+    "let b = 5;\n"
+    "while (10 - a) {\n"
+    "    a = a + 1;\n"
+    "    b = b * 3;\n"
+    "}\n"
+    "exit(b / 7);\n"
+};
+const std::set<int> SAMPLE_LINES{ 1, 2, 3, 4, 5, 7 };
+
+void checkRegions() {
+    const std::vector<LineEntry> entries{
+        { .offset = 4, .line = 1 },
+        { .offset = 9, .line = 1 }, // same line, merged
+        { .offset = 12, .line = 3 },
+        { .offset = 12, .line = 2 }, // empty, dropped
+        { .offset = 20, .line = 1 },
+    };
+    const std::vector<LineRegion> regions{ lineRegions(entries, 30) };
+    const std::vector<LineRegion> expected{
+        { .start = 0, .size = 4, .line = 0 },
+        { .start = 4, .size = 8, .line = 1 },
+        { .start = 12, .size = 8, .line = 2 },
+        { .start = 20, .size = 10, .line = 1 },
+    };
+    bool same{ regions.size() == expected.size() };
+    for (size_t i{ 0 }; same && i < regions.size(); ++i) {
+        same = regions[i].start == expected[i].start && regions[i].size == expected[i].size && regions[i].line == expected[i].line;
+    }
+    if (!same) {
+        error("lineRegions merged the entries wrongly");
+    }
+
+    const std::vector<LineRegion> fromStart{ lineRegions({ { .offset = 0, .line = 5 } }, 7) };
+    if (fromStart.size() != 1 || fromStart.front().line != 5 || fromStart.front().size != 7) {
+        error("lineRegions kept an empty region before the first line");
+    }
+}
+
+// Output of a shell command that has to succeed
+std::string run(const std::string &command) {
+    FILE *const pipe{ popen(command.c_str(), "r") };
+    if (!pipe) {
+        error("Cannot run: " + command);
+    }
+    std::string output{};
+    char buffer[256]{};
+    while (std::fgets(buffer, sizeof(buffer), pipe)) {
+        output += buffer;
+    }
+    if (pclose(pipe) != 0) {
+        error("Failed: " + command);
+    }
+    return output;
+}
+
+struct Symbol {
+    std::string address{}; // hex, as readelf prints it
+    std::string name{};
+};
+
+// The FUNC symbols of `readelf -sW`
+std::vector<Symbol> functionSymbols(const std::string &listing) {
+    std::vector<Symbol> symbols{};
+    std::stringstream lines{ listing };
+    for (std::string line{}; std::getline(lines, line);) {
+        std::stringstream fields{ line };
+        std::string num{}, value{}, size{}, type{}, bind{}, vis{}, ndx{}, name{};
+        if (fields >> num >> value >> size >> type >> bind >> vis >> ndx >> name && type == "FUNC") {
+            symbols.push_back({ .address = value, .name = name });
+        }
+    }
+    return symbols;
+}
+
+void checkProgram(const std::string &compiler, const std::string &dir, const std::string &flags) {
+    const std::string what{ flags.empty() ? "optimized" : flags };
+    run("cd '" + dir + "' && '" + compiler + "' " + flags + " " + SAMPLE_NAME);
+    const std::string program{ "'" + dir + "/out'" };
+
+    // a region for every line with code, named after it
+    std::set<int> lines{};
+    std::string addresses{};
+    std::vector<std::string> names{};
+    for (const Symbol &symbol : functionSymbols(run("readelf -sW " + program))) {
+        if (symbol.name == "_start") {
+            continue;
+        }
+        const std::string prefix{ std::string{ SAMPLE_NAME } + ":" };
+        if (!symbol.name.starts_with(prefix)) {
+            error(what + ": unexpected symbol " + symbol.name);
+        }
+        lines.insert(std::stoi(symbol.name.substr(prefix.size())));
+        addresses += " 0x" + symbol.address;
+        names.push_back(symbol.name);
+    }
+    if (lines != SAMPLE_LINES) {
+        error(what + ": the symbols don't cover the lines of the sample");
+    }
+
+    // the line program agrees with the symbols at their starts, and on the entry point
+    std::stringstream resolved{ run("addr2line -e " + program + addresses) };
+    for (const std::string &name : names) {
+        std::string line{};
+        std::getline(resolved, line);
+        if (line != name) {
+            error(what + ": addr2line gives " + line + " for the region of " + name);
+        }
+    }
+    const std::string header{ run("readelf -hW " + program) };
+    const size_t entry{ header.find("Entry point address:") };
+    std::stringstream entryFields{ header.substr(entry + std::string{ "Entry point address:" }.size()) };
+    std::string entryAddress{};
+    entryFields >> entryAddress;
+    std::string entryLine{ run("addr2line -e " + program + " " + entryAddress) };
+    entryLine.pop_back(); // newline
+    if (entryLine != std::string{ SAMPLE_NAME } + ":1") {
+        error(what + ": addr2line gives " + entryLine + " for the entry point");
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        error("Usage: line_table_check <compile> <work directory>");
+    }
+    const std::string compiler{ argv[1] };
+    const std::string dir{ argv[2] };
+
+    checkRegions();
+
+    std::ofstream{ dir + "/" + SAMPLE_NAME } << SAMPLE;
+    checkProgram(compiler, dir, "--no-opt");
+    checkProgram(compiler, dir, "");
+
+    std::cout << "line tables match the sample\n";
+    return 0;
+}
@@ -0,0 +1,151 @@
+// Checks the rewrites of strength reduction against plain `*` and `/`: every constant is
+// reduced in a one-instruction function whose result is then computed from the rewritten
+// instructions, over edge and random operands. Exits with 1 on the first mismatch.
+
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t, std::stoul
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "ir.h"
+#include "strength_reduction.h"
+
+constexpr uint64_t MAX{ ~uint64_t{ 0 } };
+
+// `%1 = op %0, c`, or `%1 = op c, %0` with `constantFirst`, exiting with %1
+IrFunction makeFunction(const IrOp op, const uint64_t c, const bool constantFirst) {
+    IrFunction fn{ .vregCount = 2 };
+    IrBlock block{};
+    const IrOperand x{ IrOperand::v(0) };
+    const IrOperand constant{ IrOperand::i(c) };
+    block.instrs.push_back({ .op = op, .dst = 1, .a = constantFirst ? constant : x, .b = constantFirst ? x : constant });
+    block.term = { .kind = IrTerm::Kind::EXIT, .value = IrOperand::v(1) };
+    fn.blocks.push_back(block);
+    return fn;
+}
+
+// Runs the single block with `x` in %0
+uint64_t evaluate(const IrFunction &fn, const uint64_t x) {
+    std::vector<uint64_t> regs(fn.vregCount);
+    regs[0] = x;
+    const auto value{ [&regs](const IrOperand &operand) {
+        return operand.isVreg() ? regs[operand.vreg()] : operand.value;
+    } };
+    for (const IrInstr &instr : fn.blocks.front().instrs) {
+        const uint64_t a{ value(instr.a) };
+        const uint64_t b{ value(instr.b) };
+        switch (instr.op) {
+        case IrOp::COPY:
+            regs[instr.dst] = a;
+            break;
+        case IrOp::ADD:
+            regs[instr.dst] = a + b;
+            break;
+        case IrOp::SUB:
+            regs[instr.dst] = a - b;
+            break;
+        case IrOp::MUL:
+            regs[instr.dst] = a * b;
+            break;
+        case IrOp::DIV:
+            regs[instr.dst] = a / b;
+            break;
+        case IrOp::MULHU:
+            regs[instr.dst] = static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+            break;
+        case IrOp::SHL:
+            regs[instr.dst] = a << b;
+            break;
+        case IrOp::SHR:
+            regs[instr.dst] = a >> b;
+            break;
+        }
+    }
+    return value(fn.blocks.front().term.value);
+}
+
+bool contains(const IrFunction &fn, const IrOp op) {
+    for (const IrInstr &instr : fn.blocks.front().instrs) {
+        if (instr.op == op) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 0 to 64, then 2^k and 2^k +- 1 for every k, then the top values and random ones
+std::vector<uint64_t> constants(std::mt19937_64 &rng, const size_t randomCount) {
+    std::vector<uint64_t> values{};
+    for (uint64_t c{ 0 }; c <= 64; ++c) {
+        values.push_back(c);
+    }
+    for (unsigned k{ 1 }; k < 64; ++k) {
+        const uint64_t power{ uint64_t{ 1 } << k };
+        values.insert(values.end(), { power - 1, power, power + 1 });
+    }
+    values.insert(values.end(), { MAX - 1, MAX, 7, 10, 641, 6700417, 1000000007 });
+    for (size_t i{ 0 }; i < randomCount; ++i) {
+        values.push_back(rng() >> (rng() % 64)); // all magnitudes
+    }
+    return values;
+}
+
+// 0, 1, d - 1, d, d + 1, 2^63, 2^64 - 1, the largest multiple of d and its neighbours,
+// then random ones
+std::vector<uint64_t> operands(std::mt19937_64 &rng, const uint64_t d, const size_t randomCount) {
+    const uint64_t lastMultiple{ d == 0 ? 0 : MAX - MAX % d };
+    std::vector<uint64_t> values{ 0, 1, d - 1, d, d + 1, uint64_t{ 1 } << 63, MAX - 1, MAX, lastMultiple - 1, lastMultiple };
+    for (size_t i{ 0 }; i < randomCount; ++i) {
+        values.push_back(rng() >> (rng() % 64));
+    }
+    return values;
+}
+
+void check(const IrOp op, const uint64_t c, const bool constantFirst, const std::vector<uint64_t> &xs, size_t &checks) {
+    IrFunction fn{ makeFunction(op, c, constantFirst) };
+    StrengthReduction{}.run(fn);
+    if (op == IrOp::DIV && c != 0 && contains(fn, IrOp::DIV)) {
+        error("Division by " + std::to_string(c) + " wasn't reduced");
+    }
+
+    for (const uint64_t x : xs) {
+        const uint64_t expected{ op == IrOp::MUL ? x * c : x / c };
+        const uint64_t actual{ evaluate(fn, x) };
+        if (actual != expected) {
+            const std::string expr{ constantFirst ? std::to_string(c) + " * " + std::to_string(x)
+                : std::to_string(x) + (op == IrOp::MUL ? " * " : " / ") + std::to_string(c) };
+            error("Mismatch: " + expr + " is " + std::to_string(expected) + ", the reduced code gives "
+                + std::to_string(actual) + "\n" + to_string(fn));
+        }
+        ++checks;
+    }
+}
+
+int main(int argc, char **argv) {
+    const size_t randomCount{ argc > 1 ? std::stoul(argv[1]) : 2000 };
+
+    std::mt19937_64 rng{ 42 };
+    size_t checks{};
+    for (const uint64_t c : constants(rng, randomCount)) {
+        const std::vector<uint64_t> xs{ operands(rng, c, 64) };
+        check(IrOp::MUL, c, false, xs, checks);
+        check(IrOp::MUL, c, true, xs, checks);
+        if (c != 0) {
+            check(IrOp::DIV, c, false, xs, checks);
+        }
+    }
+    // every small divisor against every dividend around its multiples
+    for (uint64_t d{ 1 }; d <= 4096; ++d) {
+        std::vector<uint64_t> xs{};
+        for (uint64_t k{ 0 }; k <= 4; ++k) {
+            xs.insert(xs.end(), { k * d - 1, k * d, k * d + 1, MAX - k * d });
+        }
+        check(IrOp::DIV, d, false, xs, checks);
+    }
+
+    std::cout << checks << " products and quotients match\n";
+    return 0;
+}
@@ -1,42 +1,170 @@
 #pragma once
 
+#include <algorithm> // std::max, std::min
 #include <cstddef> // std::byte
-#include <cstdlib> // size_t, malloc, free
-#include <memory> // std::align
+#include <cstdlib> // size_t
+#include <memory> // std::align, std::unique_ptr
+#include <new> // placement new
+#include <type_traits> // std::is_trivially_destructible_v
 #include <utility> // std::forward
+#include <vector>
 
+struct ArenaStats {
+    size_t usedBytes{}; // handed out, objects and their destructor records
+    size_t paddingBytes{}; // skipped to align objects
+    size_t reservedBytes{}; // held in chunks
+    size_t chunkCount{};
+};
+
+// Bump allocator over a list of chunks. The first chunk is small, and each one added is
+// twice the size of the last, up to MAX_CHUNK_SIZE, so small programs reserve little and
+// large ones take few chunks. `emplace` records the destructor of objects that have one
+// (the statement vectors of scopes) to run when their memory is given back. `mark` and
+// `release` give back everything allocated in between; `reset` gives back everything. Both
+// keep the chunks for the allocations that follow.
 class ArenaAllocator {
+private:
+    struct Finalizer;
+
 public:
-    ArenaAllocator() = delete;
+    // Where the arena stood, to release() back to
+    struct Mark {
+        size_t chunk{};
+        std::byte *offset{};
+        Finalizer *finalizers{};
+        size_t usedBytes{};
+        size_t paddingBytes{};
+    };
+
     ArenaAllocator(const ArenaAllocator &) = delete;
     ArenaAllocator &operator=(const ArenaAllocator &) = delete;
 
-    explicit ArenaAllocator(const size_t bytes) :
-        mSize{ bytes },
-        mBuffer{ new std::byte[mSize] },
-        mOffset{ mBuffer } {}
+    explicit ArenaAllocator(const size_t firstChunkSize = FIRST_CHUNK_SIZE) :
+        mNextChunkSize{ std::max<size_t>(firstChunkSize, 1) } {}
+
+    ~ArenaAllocator() {
+        finalize(nullptr);
+    }
 
     template <typename T>
     [[nodiscard]] T *alloc() {
-        size_t remainingBytes{ static_cast<size_t>(mBuffer + mSize - mOffset) };
-        void *offset{ static_cast<void *>(mOffset) };
-        void *const aligned{ std::align(alignof(T), sizeof(T), offset, remainingBytes) };
-        if (!aligned) {
-            return nullptr;
-        }
-        mOffset = static_cast<std::byte *>(aligned) + sizeof(T);
-        return static_cast<T *>(aligned);
+        return static_cast<T *>(allocBytes(sizeof(T), alignof(T)));
     }
 
     template <typename T, typename... Args>
     [[nodiscard]] T *emplace(Args &&...args)
     {
         T *const allocatedMemory{ alloc<T>() };
-        return new (allocatedMemory) T{ std::forward<Args>(args)... };
+        T *const object{ new (allocatedMemory) T{ std::forward<Args>(args)... } };
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            Finalizer *const finalizer{ alloc<Finalizer>() };
+            *finalizer = { .destroy = [](void *const destroyed) { static_cast<T *>(destroyed)->~T(); }, .object = object, .next = mFinalizers };
+            mFinalizers = finalizer;
+        }
+        return object;
+    }
+
+    [[nodiscard]] Mark mark() const {
+        return { .chunk = mChunk, .offset = mOffset, .finalizers = mFinalizers, .usedBytes = mUsedBytes, .paddingBytes = mPaddingBytes };
+    }
+
+    // Destroys and gives back everything allocated since `mark`, which must not be older
+    // than the last reset
+    void release(const Mark &mark) {
+        finalize(mark.finalizers);
+        mChunk = mark.chunk;
+        mOffset = mark.offset;
+        if (!mOffset && !mChunks.empty()) { // marked before the first chunk
+            mOffset = mChunks.front().data.get();
+        }
+        mUsedBytes = mark.usedBytes;
+        mPaddingBytes = mark.paddingBytes;
+    }
+
+    void reset() {
+        release({});
+    }
+
+    [[nodiscard]] ArenaStats stats() const {
+        size_t reservedBytes{};
+        for (const Chunk &chunk : mChunks) {
+            reservedBytes += chunk.size;
+        }
+        return { .usedBytes = mUsedBytes, .paddingBytes = mPaddingBytes, .reservedBytes = reservedBytes, .chunkCount = mChunks.size() };
     }
 
 private:
-    size_t mSize{};
-    std::byte *mBuffer{};
-    std::byte *mOffset{ mBuffer };
+    static constexpr size_t FIRST_CHUNK_SIZE{ 64 * 1024 };
+    static constexpr size_t MAX_CHUNK_SIZE{ 16 * 1024 * 1024 };
+
+    struct Chunk {
+        std::unique_ptr<std::byte[]> data{};
+        size_t size{};
+    };
+
+    struct Finalizer {
+        void (*destroy)(void *){};
+        void *object{};
+        Finalizer *next{};
+    };
+
+    void *allocBytes(const size_t size, const size_t alignment) {
+        if (void *const aligned{ alignIn(size, alignment) }) {
+            return aligned;
+        }
+        // The rest of the current chunk stays unused until a release goes back into it
+        do {
+            nextChunk(size + alignment);
+        } while (mChunks[mChunk].size < size + alignment);
+        return alignIn(size, alignment);
+    }
+
+    // Bumps the offset in the current chunk, or returns nullptr if the object doesn't fit
+    void *alignIn(const size_t size, const size_t alignment) {
+        if (mChunks.empty()) {
+            return nullptr;
+        }
+        const Chunk &chunk{ mChunks[mChunk] };
+        size_t remainingBytes{ static_cast<size_t>(chunk.data.get() + chunk.size - mOffset) };
+        void *offset{ static_cast<void *>(mOffset) };
+        void *const aligned{ std::align(alignment, size, offset, remainingBytes) };
+        if (!aligned) {
+            return nullptr;
+        }
+        mPaddingBytes += static_cast<size_t>(static_cast<std::byte *>(aligned) - mOffset);
+        mUsedBytes += size;
+        mOffset = static_cast<std::byte *>(aligned) + size;
+        return aligned;
+    }
+
+    // Moves to the chunk after the current one, adding it if none was kept from before.
+    // A kept chunk too small for `minSize` is still moved through, as the loop in
+    // allocBytes goes on to the next.
+    void nextChunk(const size_t minSize) {
+        const size_t next{ mChunks.empty() ? 0 : mChunk + 1 };
+        if (next == mChunks.size()) {
+            const size_t size{ std::max(mNextChunkSize, minSize) };
+            mChunks.push_back({ .data = std::unique_ptr<std::byte[]>{ new std::byte[size] }, .size = size });
+            mNextChunkSize = std::min(mNextChunkSize * 2, MAX_CHUNK_SIZE);
+        }
+        mChunk = next;
+        mOffset = mChunks[mChunk].data.get();
+    }
+
+    // Runs the destructors recorded after `last`, newest first
+    void finalize(const Finalizer *const last) {
+        while (mFinalizers != last) {
+            Finalizer *const finalizer{ mFinalizers };
+            mFinalizers = finalizer->next;
+            finalizer->destroy(finalizer->object);
+        }
+    }
+
+    std::vector<Chunk> mChunks{};
+    size_t mChunk{}; // the one being filled
+    std::byte *mOffset{};
+    Finalizer *mFinalizers{}; // newest first
+    size_t mNextChunkSize{};
+    size_t mUsedBytes{};
+    size_t mPaddingBytes{};
 };
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <string>
+
+#include "x86.h"
+
+// Renders an instruction list as NASM source (debug dump and `--nasm` path)
+class AsmWriter {
+public:
+    AsmWriter(const AsmWriter &) = delete;
+    AsmWriter &operator=(const AsmWriter &) = delete;
+
+    AsmWriter() = default;
+
+    // The text stays owned by the writer, so it goes to the file without another copy
+    [[nodiscard]] const std::string &render(const InstrList &instrs) {
+        mOutput += "global _start\n";
+        mOutput += "_start:\n";
+
+        for (const Instr &instr : instrs) {
+            renderInstr(instr);
+        }
+
+        return mOutput;
+    }
+
+private:
+    void renderInstr(const Instr &instr) {
+        switch (instr.op) {
+        case Op::LABEL:
+            mOutput += labelName(instr.dst.label) + ":\n";
+            return;
+        case Op::COMMENT:
+            mOutput += "    ; " + instr.text + "\n";
+            return;
+        case Op::LINE:
+            mOutput += "    ; line " + std::to_string(instr.dst.imm) + "\n";
+            return;
+        default:
+            break;
+        }
+
+        mOutput += "    " + mnemonic(instr.op);
+        if (instr.dst.kind != Operand::Kind::NONE) {
+            mOutput += " " + operand(instr.dst);
+        }
+        if (instr.src.kind != Operand::Kind::NONE) {
+            mOutput += ", " + operand(instr.src);
+        }
+        if (instr.src2.kind != Operand::Kind::NONE) {
+            mOutput += ", " + operand(instr.src2);
+        }
+        mOutput += "\n";
+    }
+
+    static std::string mnemonic(const Op op) {
+        switch (op) {
+        case Op::MOV:
+            return "mov";
+        case Op::LEA:
+            return "lea";
+        case Op::PUSH:
+            return "push";
+        case Op::POP:
+            return "pop";
+        case Op::ADD:
+            return "add";
+        case Op::SUB:
+            return "sub";
+        case Op::MUL:
+            return "mul";
+        case Op::IMUL:
+            return "imul";
+        case Op::DIV:
+            return "div";
+        case Op::XOR:
+            return "xor";
+        case Op::SHL:
+            return "shl";
+        case Op::SHR:
+            return "shr";
+        case Op::CMP:
+            return "cmp";
+        case Op::TEST:
+            return "test";
+        case Op::JMP:
+            return "jmp";
+        case Op::JZ:
+            return "jz";
+        case Op::JNZ:
+            return "jnz";
+        case Op::SYSCALL:
+            return "syscall";
+        case Op::RET:
+            return "ret";
+        case Op::LABEL:
+        case Op::COMMENT:
+        case Op::LINE:
+            break;
+        }
+
+        return {}; // unreachable
+    }
+
+    static std::string operand(const Operand &op) {
+        switch (op.kind) {
+        case Operand::Kind::REG:
+            return to_string(op.reg);
+        case Operand::Kind::IMM:
+            return std::to_string(op.imm);
+        case Operand::Kind::MEM: {
+            std::string address{ to_string(op.reg) };
+            if (op.scale != 0) {
+                address += " + " + to_string(op.index) + "*" + std::to_string(op.scale);
+            }
+            if (op.imm < 0) {
+                return "QWORD [" + address + " - " + std::to_string(-op.imm) + "]";
+            }
+            return "QWORD [" + address + " + " + std::to_string(op.imm) + "]";
+        }
+        case Operand::Kind::LABEL:
+            return labelName(op.label);
+        case Operand::Kind::NONE:
+            break;
+        }
+
+        return {}; // unreachable
+    }
+
+    std::string mOutput{};
+};
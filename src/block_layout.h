@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t
+#include <deque>
+#include <vector>
+
+#include "ir.h"
+
+// Orders the blocks into fall-through chains so the generator can leave out jumps to the
+// next block. A chain follows each block's preferred successor: the target of a `jmp`, and
+// for a branch the side that isn't a join point, taking the zero side on a tie. That keeps
+// an elif ladder's conditions in one straight line, with the bodies out of line after it.
+// With a profile a branch prefers the side that ran more often, so the hot path falls
+// through and the generator inverts the condition to jump to the cold side.
+class BlockLayout {
+public:
+    BlockLayout(const BlockLayout &) = delete;
+    BlockLayout &operator=(const BlockLayout &) = delete;
+
+    BlockLayout() = default;
+
+    void run(IrFunction &fn) {
+        removeUnreachableBlocks(fn);
+
+        std::vector<size_t> order{};
+        std::vector<bool> placed(fn.blocks.size());
+        std::deque<size_t> pending{ 0 };
+
+        while (!pending.empty()) {
+            size_t block{ pending.front() };
+            pending.pop_front();
+            while (!placed[block]) {
+                placed[block] = true;
+                order.push_back(block);
+
+                const IrTerm &term{ fn.blocks[block].term };
+                if (term.kind == IrTerm::Kind::JMP) {
+                    block = term.target;
+                } else if (term.kind == IrTerm::Kind::BRANCH) {
+                    const bool fallToTarget{ prefersTarget(fn, term) };
+                    pending.push_back(fallToTarget ? term.elseTarget : term.target);
+                    block = fallToTarget ? term.target : term.elseTarget;
+                }
+            }
+        }
+
+        reorderBlocks(fn, order);
+    }
+
+private:
+    static bool prefersTarget(const IrFunction &fn, const IrTerm &term) {
+        const uint64_t targetCount{ fn.blocks[term.target].count };
+        const uint64_t elseCount{ fn.blocks[term.elseTarget].count };
+        if (fn.profiled && targetCount != elseCount) {
+            return targetCount > elseCount;
+        }
+        return isJoin(fn, term.elseTarget) && !isJoin(fn, term.target);
+    }
+
+    static bool isJoin(const IrFunction &fn, const size_t block) {
+        return fn.blocks[block].preds.size() > 1;
+    }
+};
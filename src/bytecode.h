@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm> // std::max
+#include <cstdint> // int64_t, uint8_t, uint32_t
+#include <cstdlib> // size_t
+#include <cstring> // std::memcpy
+#include <stack>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility> // std::move
+#include <variant> // std::visit
+#include <vector>
+
+#include "error.h"
+#include "parser.h"
+
+// Opcodes are one byte, followed by their inline operand (if any)
+enum class OpCode : uint8_t {
+    PUSH, // i64 immediate
+    LOAD, // u32 slot
+    STORE, // u32 slot, pops
+    ADD, SUB, MUL, DIV,
+    JZ, // u32 target, pops
+    JMP, // u32 target
+    EXIT, // pops the exit value
+};
+
+struct Bytecode {
+    std::vector<uint8_t> code{};
+    size_t slotCount{}; // variable slots live at the same time
+    size_t stackDepth{}; // operand stack depth
+};
+
+// Compiles the AST into stack-machine bytecode. Variables get slots the same way
+// `Generator` gives them stack locations: a slot is released when its scope ends.
+class BytecodeCompiler {
+public:
+    BytecodeCompiler(const BytecodeCompiler &) = delete;
+    BytecodeCompiler &operator=(const BytecodeCompiler &) = delete;
+
+    BytecodeCompiler() = default;
+
+    void compileTerm(const NodeTerm *const term) {
+        std::visit(Visitor{
+
+            [this](const NodeTermIntLiteral *const intLiteralTerm) {
+                emitOp(OpCode::PUSH);
+                emitOperand(static_cast<int64_t>(intLiteralTerm->value));
+            },
+
+            [this](const NodeTermIdentifier *const identifierTerm) {
+                const auto it{ mVars.find(identifierTerm->identifier.name) };
+                if (it == mVars.cend()) {
+                    error("Undeclared variable: " + std::string{ identifierTerm->identifier.name });
+                }
+                emitOp(OpCode::LOAD);
+                emitOperand(it->second);
+            },
+
+            [this](const NodeTermParen *const parenTerm) {
+                compileExpr(parenTerm->expr);
+            }
+
+        }, term->term);
+    }
+
+    void compileBinExpr(const NodeBinExpr *const binExpr) {
+        std::visit(Visitor{
+
+            [this](const NodeBinExprAdd *const binExprAdd) {
+                compileExpr(binExprAdd->lhs);
+                compileExpr(binExprAdd->rhs);
+                emitOp(OpCode::ADD);
+            },
+
+            [this](const NodeBinExprSub *const binExprSub) {
+                compileExpr(binExprSub->lhs);
+                compileExpr(binExprSub->rhs);
+                emitOp(OpCode::SUB);
+            },
+
+            [this](const NodeBinExprMul *const binExprMul) {
+                compileExpr(binExprMul->lhs);
+                compileExpr(binExprMul->rhs);
+                emitOp(OpCode::MUL);
+            },
+
+            [this](const NodeBinExprDiv *const binExprDiv) {
+                compileExpr(binExprDiv->lhs);
+                compileExpr(binExprDiv->rhs);
+                emitOp(OpCode::DIV);
+            },
+
+        }, binExpr->expr);
+    }
+
+    void compileExpr(const NodeExpr *const expr) {
+        std::visit(Visitor{
+
+            [this](const NodeTerm *const term) {
+                compileTerm(term);
+            },
+
+            [this](const NodeBinExpr *const binExpr) {
+                compileBinExpr(binExpr);
+            },
+
+        }, expr->expr);
+    }
+
+    void compileScope(const NodeScope *const scope) {
+        beginScope();
+        for (const NodeStmt *const stmt : scope->stmts) {
+            compileStmt(stmt);
+        }
+        endScope();
+    }
+
+    void compileStmt(const NodeStmt *const stmt) {
+        std::visit(Visitor{
+
+            [this](const NodeStmtExit *const exitStmt) {
+                compileExpr(exitStmt->expr);
+                emitOp(OpCode::EXIT);
+            },
+
+            [this](const NodeStmtLet *const letStmt) {
+                if (mVars.contains(letStmt->identifier.name)) {
+                    error("Identifier already used: " + std::string{ letStmt->identifier.name });
+                }
+                compileExpr(letStmt->expr); // the initializer can't see the new variable
+
+                const uint32_t slot{ static_cast<uint32_t>(mVars.size()) };
+                mVars[letStmt->identifier.name] = slot;
+                mVarOrder.push(letStmt->identifier.name);
+                mBytecode.slotCount = std::max(mBytecode.slotCount, mVars.size());
+
+                emitOp(OpCode::STORE);
+                emitOperand(slot);
+            },
+
+            [this](const NodeStmtAssign *const assignStmt) {
+                const auto it{ mVars.find(assignStmt->identifier.name) };
+                if (it == mVars.cend()) {
+                    error("Undeclared identifier: " + std::string{ assignStmt->identifier.name });
+                }
+                compileExpr(assignStmt->expr);
+                emitOp(OpCode::STORE);
+                emitOperand(it->second);
+            },
+
+            [this](const NodeStmtIf *const ifStmt) {
+                std::vector<size_t> endJumps{};
+                compileConditionAndScope(ifStmt->ifBranch->expr, ifStmt->ifBranch->scope, endJumps);
+                for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
+                    compileConditionAndScope(elifBranch->expr, elifBranch->scope, endJumps);
+                }
+                if (ifStmt->elseBranch) {
+                    compileScope(ifStmt->elseBranch->scope);
+                }
+                for (const size_t jump : endJumps) {
+                    patchTarget(jump, here());
+                }
+            },
+
+            [this](const NodeStmtWhile *const whileStmt) {
+                const size_t top{ here() };
+                compileExpr(whileStmt->expr);
+                emitOp(OpCode::JZ);
+                const size_t endJump{ here() };
+                emitOperand(uint32_t{ 0 });
+
+                compileScope(whileStmt->scope);
+
+                emitOp(OpCode::JMP);
+                emitOperand(static_cast<uint32_t>(top));
+                patchTarget(endJump, here());
+            },
+
+            [this](const NodeScope *const scope) {
+                compileScope(scope);
+            },
+
+        }, stmt->stmt);
+    }
+
+    [[nodiscard]] Bytecode compileProg(const NodeProg *const prog) {
+        for (const NodeStmt *const stmt : prog->stmts) {
+            compileStmt(stmt);
+        }
+
+        // Exit with zero if no `exit` statement
+        emitOp(OpCode::PUSH);
+        emitOperand(int64_t{ 0 });
+        emitOp(OpCode::EXIT);
+
+        return std::move(mBytecode);
+    }
+
+private:
+    // Helper type for the visitor
+    template<typename... Ts>
+    struct Visitor : Ts... {
+        using Ts::operator()...;
+    };
+
+    static int stackEffect(const OpCode op) {
+        switch (op) {
+        case OpCode::PUSH:
+        case OpCode::LOAD:
+            return 1;
+        case OpCode::JMP:
+            return 0;
+        case OpCode::STORE:
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::MUL:
+        case OpCode::DIV:
+        case OpCode::JZ:
+        case OpCode::EXIT:
+            return -1;
+        }
+
+        return {}; // unreachable
+    }
+
+    void compileConditionAndScope(
+        const NodeExpr *const condExpr,
+        const NodeScope *const scope,
+        std::vector<size_t> &endJumps
+    ) {
+        compileExpr(condExpr);
+        emitOp(OpCode::JZ);
+        const size_t falseJump{ here() };
+        emitOperand(uint32_t{ 0 });
+
+        compileScope(scope);
+
+        emitOp(OpCode::JMP);
+        endJumps.push_back(here());
+        emitOperand(uint32_t{ 0 });
+
+        patchTarget(falseJump, here());
+    }
+
+    void beginScope() {
+        mScopes.push(mVars.size());
+    }
+
+    void endScope() {
+        const size_t popCount{ mVars.size() - mScopes.top() };
+        for (size_t i{ 0 }; i < popCount; ++i) {
+            mVars.erase(mVarOrder.top());
+            mVarOrder.pop();
+        }
+        mScopes.pop();
+    }
+
+    size_t here() const {
+        return mBytecode.code.size();
+    }
+
+    void emitOp(const OpCode op) {
+        mBytecode.code.push_back(static_cast<uint8_t>(op));
+        mDepth += stackEffect(op);
+        mBytecode.stackDepth = std::max(mBytecode.stackDepth, static_cast<size_t>(mDepth));
+    }
+
+    template <typename T>
+    void emitOperand(const T value) {
+        const size_t pos{ here() };
+        mBytecode.code.resize(pos + sizeof(T));
+        std::memcpy(mBytecode.code.data() + pos, &value, sizeof(T));
+    }
+
+    void patchTarget(const size_t pos, const size_t target) {
+        const uint32_t value{ static_cast<uint32_t>(target) };
+        std::memcpy(mBytecode.code.data() + pos, &value, sizeof(value));
+    }
+
+    Bytecode mBytecode{};
+    int mDepth{};
+    std::unordered_map<std::string_view, uint32_t> mVars{};
+    std::stack<std::string_view, std::vector<std::string_view>> mVarOrder{};
+    std::stack<size_t, std::vector<size_t>> mScopes{};
+};
@@ -0,0 +1,424 @@
+#pragma once
+
+#include <algorithm> // std::none_of
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t
+#include <optional>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <type_traits> // std::is_same_v, std::remove_cvref_t
+#include <unordered_map>
+#include <unordered_set>
+#include <utility> // std::move, std::pair
+#include <variant> // std::visit, std::get_if
+#include <vector>
+
+#include "arena_allocator.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+struct FoldStats {
+    size_t foldedExprs{}; // binary expressions replaced by their value
+    size_t propagatedUses{}; // variable reads replaced by a known value
+    size_t eliminatedNodes{}; // AST nodes removed from expressions
+};
+
+// Folds binary expressions over literals and propagates the values of variables known
+// at each point through `let` and assignments. Branches are analysed with the values
+// known on entry; afterwards a variable keeps its value only if every branch that can
+// fall through agrees on it. Branches ending in `exit` don't reach the join. A loop
+// forgets the values of the variables its body assigns before folding its condition.
+// Division by zero is left for the program to trap on at run time.
+class ConstantFolder {
+public:
+    ConstantFolder(const ConstantFolder &) = delete;
+    ConstantFolder &operator=(const ConstantFolder &) = delete;
+
+    ConstantFolder() = default;
+
+    const NodeExpr *foldExpr(const NodeExpr *const expr) {
+        return std::visit(Visitor{
+
+            [this, expr](const NodeTerm *const term) -> const NodeExpr * {
+                return foldTerm(expr, term);
+            },
+
+            [this, expr](const NodeBinExpr *const binExpr) -> const NodeExpr * {
+                return foldBinExpr(expr, binExpr);
+            },
+
+        }, expr->expr);
+    }
+
+    const NodeScope *foldScope(const NodeScope *const scope) {
+        beginScope();
+        NodeScope *const folded{ mAllocator.emplace<NodeScope>() };
+        for (const NodeStmt *const stmt : scope->stmts) {
+            folded->stmts.push_back(foldStmt(stmt));
+        }
+        endScope();
+
+        return folded;
+    }
+
+    const NodeStmt *foldStmt(const NodeStmt *const stmt) {
+        return std::visit(Visitor{
+
+            [this](const NodeStmtExit *const exitStmt) -> const NodeStmt * {
+                const NodeExpr *const expr{ foldRoot(exitStmt->expr) };
+                mTerminated = true;
+                return mAllocator.emplace<NodeStmt>(mAllocator.emplace<NodeStmtExit>(expr));
+            },
+
+            [this](const NodeStmtLet *const letStmt) -> const NodeStmt * {
+                const NodeExpr *const expr{ foldRoot(letStmt->expr) };
+                const std::string_view name{ letStmt->identifier.name };
+                if (!mVars.contains(name)) { // redeclarations are reported by the backends
+                    mVarOrder.push(name);
+                }
+                mVars[name] = literalValue(expr);
+                return mAllocator.emplace<NodeStmt>(mAllocator.emplace<NodeStmtLet>(letStmt->identifier, expr));
+            },
+
+            [this](const NodeStmtAssign *const assignStmt) -> const NodeStmt * {
+                const NodeExpr *const expr{ foldRoot(assignStmt->expr) };
+                const auto it{ mVars.find(assignStmt->identifier.name) };
+                if (it != mVars.end()) {
+                    it->second = literalValue(expr);
+                }
+                return mAllocator.emplace<NodeStmt>(mAllocator.emplace<NodeStmtAssign>(assignStmt->identifier, expr));
+            },
+
+            [this](const NodeStmtIf *const ifStmt) -> const NodeStmt * {
+                return mAllocator.emplace<NodeStmt>(foldIf(ifStmt));
+            },
+
+            [this](const NodeStmtWhile *const whileStmt) -> const NodeStmt * {
+                return mAllocator.emplace<NodeStmt>(foldWhile(whileStmt));
+            },
+
+            [this](const NodeScope *const scope) -> const NodeStmt * {
+                return mAllocator.emplace<NodeStmt>(foldScope(scope));
+            },
+
+        }, stmt->stmt);
+    }
+
+    [[nodiscard]] const NodeProg *foldProg(const NodeProg *const prog) {
+        NodeProg *const folded{ mAllocator.emplace<NodeProg>() };
+        for (const NodeStmt *const stmt : prog->stmts) {
+            folded->stmts.push_back(foldStmt(stmt));
+        }
+
+        return folded;
+    }
+
+    [[nodiscard]] const FoldStats &stats() const {
+        return mStats;
+    }
+
+    // Memory of the nodes it made
+    [[nodiscard]] ArenaStats arenaStats() const {
+        return mAllocator.stats();
+    }
+
+private:
+    // Helper type for the visitor
+    template<typename... Ts>
+    struct Visitor : Ts... {
+        using Ts::operator()...;
+    };
+
+    using Env = std::unordered_map<std::string_view, std::optional<uint64_t>>;
+
+    // Variable values on a path that leaves a branch
+    struct BranchOutcome {
+        Env vars{};
+        bool reachesJoin{};
+    };
+
+    static size_t countNodes(const NodeExpr *const expr) {
+        return 1 + std::visit(Visitor{
+
+            [](const NodeTerm *const term) -> size_t {
+                if (const auto *const parenTerm{ std::get_if<const NodeTermParen *>(&term->term) }) {
+                    return 2 + countNodes((*parenTerm)->expr);
+                }
+                return 2;
+            },
+
+            [](const NodeBinExpr *const binExpr) -> size_t {
+                return 2 + std::visit([](const auto *const bin) {
+                    return countNodes(bin->lhs) + countNodes(bin->rhs);
+                }, binExpr->expr);
+            },
+
+        }, expr->expr);
+    }
+
+    const NodeExpr *makeLiteral(const uint64_t value, const int ln) {
+        const NodeTermIntLiteral *const intLiteralTerm{ mAllocator.emplace<NodeTermIntLiteral>(value, ln) };
+        return mAllocator.emplace<NodeExpr>(mAllocator.emplace<NodeTerm>(intLiteralTerm));
+    }
+
+    // Folds a statement-level expression and accounts for the nodes it lost
+    const NodeExpr *foldRoot(const NodeExpr *const expr) {
+        const NodeExpr *const folded{ foldExpr(expr) };
+        if (folded != expr) {
+            mStats.eliminatedNodes += countNodes(expr) - countNodes(folded);
+        }
+        return folded;
+    }
+
+    const NodeExpr *foldTerm(const NodeExpr *const expr, const NodeTerm *const term) {
+        return std::visit(Visitor{
+
+            [expr](const NodeTermIntLiteral *const) {
+                return expr;
+            },
+
+            [this, expr](const NodeTermIdentifier *const identifierTerm) {
+                const auto it{ mVars.find(identifierTerm->identifier.name) };
+                if (it == mVars.cend() || !it->second) {
+                    return expr;
+                }
+                ++mStats.propagatedUses;
+                return makeLiteral(*it->second, identifierTerm->identifier.ln);
+            },
+
+            [this, expr](const NodeTermParen *const parenTerm) {
+                const NodeExpr *const inner{ foldExpr(parenTerm->expr) };
+                if (inner == parenTerm->expr) {
+                    return expr;
+                }
+                if (literalValue(inner)) { // parentheses around a literal are redundant
+                    return inner;
+                }
+                const NodeTermParen *const folded{ mAllocator.emplace<NodeTermParen>(inner) };
+                return static_cast<const NodeExpr *>(mAllocator.emplace<NodeExpr>(mAllocator.emplace<NodeTerm>(folded)));
+            },
+
+        }, term->term);
+    }
+
+    const NodeExpr *foldBinExpr(const NodeExpr *const expr, const NodeBinExpr *const binExpr) {
+        return std::visit([this, expr](const auto *const bin) -> const NodeExpr * {
+            using BinNode = std::remove_cvref_t<decltype(*bin)>;
+
+            const ArenaAllocator::Mark operands{ mAllocator.mark() };
+            const NodeExpr *const lhs{ foldExpr(bin->lhs) };
+            const NodeExpr *const rhs{ foldExpr(bin->rhs) };
+            const std::optional<uint64_t> lhsValue{ literalValue(lhs) };
+            const std::optional<uint64_t> rhsValue{ literalValue(rhs) };
+
+            if (lhsValue && rhsValue) {
+                if (const std::optional<uint64_t> value{ evaluate<BinNode>(*lhsValue, *rhsValue) }) {
+                    ++mStats.foldedExprs;
+                    const int ln{ lineOf(lhs) };
+                    mAllocator.release(operands); // the folded operands, replaced by the value
+                    return makeLiteral(*value, ln);
+                }
+            }
+
+            // x + 0, 0 + x, x - 0, x * 1, 1 * x, x / 1
+            if (rhsValue && *rhsValue == identityOperand<BinNode>()) {
+                ++mStats.foldedExprs;
+                return lhs;
+            }
+            if (lhsValue && *lhsValue == identityOperand<BinNode>() && isCommutative<BinNode>()) {
+                ++mStats.foldedExprs;
+                return rhs;
+            }
+
+            if (lhs == bin->lhs && rhs == bin->rhs) {
+                return expr;
+            }
+            NodeBinExpr *const folded{ mAllocator.emplace<NodeBinExpr>() };
+            folded->expr = mAllocator.emplace<BinNode>(lhs, rhs);
+            return mAllocator.emplace<NodeExpr>(folded);
+        }, binExpr->expr);
+    }
+
+    template <typename BinNode>
+    static std::optional<uint64_t> evaluate(const uint64_t lhs, const uint64_t rhs) {
+        if constexpr (std::is_same_v<BinNode, NodeBinExprAdd>) {
+            return lhs + rhs;
+        } else if constexpr (std::is_same_v<BinNode, NodeBinExprSub>) {
+            return lhs - rhs;
+        } else if constexpr (std::is_same_v<BinNode, NodeBinExprMul>) {
+            return lhs * rhs;
+        } else {
+            if (rhs == 0) {
+                return {};
+            }
+            return lhs / rhs;
+        }
+    }
+
+    template <typename BinNode>
+    static constexpr uint64_t identityOperand() {
+        if constexpr (std::is_same_v<BinNode, NodeBinExprAdd> || std::is_same_v<BinNode, NodeBinExprSub>) {
+            return 0;
+        } else {
+            return 1;
+        }
+    }
+
+    template <typename BinNode>
+    static constexpr bool isCommutative() {
+        return std::is_same_v<BinNode, NodeBinExprAdd> || std::is_same_v<BinNode, NodeBinExprMul>;
+    }
+
+    // Runs one branch body from the values known on entry
+    BranchOutcome foldBranch(const NodeScope *const scope, const NodeScope *&folded, const Env &entry) {
+        mVars = entry;
+        mTerminated = false;
+        folded = foldScope(scope);
+        return { .vars = mVars, .reachesJoin = !mTerminated };
+    }
+
+    const NodeStmtIf *foldIf(const NodeStmtIf *const ifStmt) {
+        const Env entry{ mVars };
+        const bool entryTerminated{ mTerminated };
+        std::vector<BranchOutcome> outcomes{};
+        bool decided{}; // an earlier condition is known to be true, the rest never runs
+
+        NodeStmtIf *const folded{ mAllocator.emplace<NodeStmtIf>() };
+
+        const auto foldCondition{ [this, &entry, &decided](const NodeExpr *const condExpr) {
+            mVars = entry;
+            const NodeExpr *const cond{ foldRoot(condExpr) };
+            const std::optional<uint64_t> value{ literalValue(cond) };
+            const bool taken{ !decided && (!value || *value != 0) };
+            decided = decided || (value && *value != 0);
+            return std::pair{ cond, taken };
+        } };
+
+        const auto [ifCond, ifTaken]{ foldCondition(ifStmt->ifBranch->expr) };
+        const NodeScope *ifScope{};
+        BranchOutcome ifOutcome{ foldBranch(ifStmt->ifBranch->scope, ifScope, entry) };
+        if (ifTaken) {
+            outcomes.push_back(std::move(ifOutcome));
+        }
+        folded->ifBranch = mAllocator.emplace<NodeBranchIf>(ifCond, ifScope);
+
+        for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
+            const auto [elifCond, elifTaken]{ foldCondition(elifBranch->expr) };
+            const NodeScope *elifScope{};
+            BranchOutcome elifOutcome{ foldBranch(elifBranch->scope, elifScope, entry) };
+            if (elifTaken) {
+                outcomes.push_back(std::move(elifOutcome));
+            }
+            folded->elifBranches.push_back(mAllocator.emplace<NodeBranchElif>(elifCond, elifScope));
+        }
+
+        if (ifStmt->elseBranch) {
+            const NodeScope *elseScope{};
+            BranchOutcome elseOutcome{ foldBranch(ifStmt->elseBranch->scope, elseScope, entry) };
+            if (!decided) {
+                outcomes.push_back(std::move(elseOutcome));
+            }
+            folded->elseBranch = mAllocator.emplace<NodeBranchElse>(elseScope);
+        } else if (!decided) {
+            outcomes.push_back({ .vars = entry, .reachesJoin = true });
+        }
+
+        join(entry, outcomes);
+        mTerminated = entryTerminated || std::none_of(outcomes.cbegin(), outcomes.cend(), [](const BranchOutcome &outcome) {
+            return outcome.reachesJoin;
+        });
+
+        return folded;
+    }
+
+    // Names assigned anywhere in the scope
+    static void collectAssigned(const NodeScope *const scope, std::unordered_set<std::string_view> &names) {
+        for (const NodeStmt *const stmt : scope->stmts) {
+            std::visit(Visitor{
+                [](const NodeStmtExit *const) {},
+                [](const NodeStmtLet *const) {},
+                [&names](const NodeStmtAssign *const assignStmt) {
+                    names.insert(assignStmt->identifier.name);
+                },
+                [&names](const NodeStmtIf *const ifStmt) {
+                    collectAssigned(ifStmt->ifBranch->scope, names);
+                    for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
+                        collectAssigned(elifBranch->scope, names);
+                    }
+                    if (ifStmt->elseBranch) {
+                        collectAssigned(ifStmt->elseBranch->scope, names);
+                    }
+                },
+                [&names](const NodeStmtWhile *const whileStmt) {
+                    collectAssigned(whileStmt->scope, names);
+                },
+                [&names](const NodeScope *const inner) {
+                    collectAssigned(inner, names);
+                },
+            }, stmt->stmt);
+        }
+    }
+
+    // The condition and body see only the values no iteration changes, and so does the code
+    // after the loop, which is reached when the condition fails
+    const NodeStmtWhile *foldWhile(const NodeStmtWhile *const whileStmt) {
+        std::unordered_set<std::string_view> assigned{};
+        collectAssigned(whileStmt->scope, assigned);
+        for (auto &[name, value] : mVars) {
+            if (assigned.contains(name)) {
+                value.reset();
+            }
+        }
+
+        const Env head{ mVars };
+        const bool entryTerminated{ mTerminated };
+        const NodeExpr *const cond{ foldRoot(whileStmt->expr) };
+        const NodeScope *const scope{ foldScope(whileStmt->scope) };
+        mVars = head;
+        mTerminated = entryTerminated;
+
+        return mAllocator.emplace<NodeStmtWhile>(cond, scope);
+    }
+
+    // A variable keeps a value after the `if` only if every path reaching the join agrees on it
+    void join(const Env &entry, const std::vector<BranchOutcome> &outcomes) {
+        mVars = entry;
+        for (auto &[name, value] : mVars) {
+            bool first{ true };
+            std::optional<uint64_t> joined{};
+            for (const BranchOutcome &outcome : outcomes) {
+                if (!outcome.reachesJoin) {
+                    continue;
+                }
+                const std::optional<uint64_t> &branchValue{ outcome.vars.at(name) };
+                if (first) {
+                    joined = branchValue;
+                    first = false;
+                } else if (joined != branchValue) {
+                    joined.reset();
+                }
+            }
+            value = first ? std::optional<uint64_t>{} : joined;
+        }
+    }
+
+    void beginScope() {
+        mScopes.push(mVarOrder.size());
+    }
+
+    void endScope() {
+        while (mVarOrder.size() > mScopes.top()) {
+            mVars.erase(mVarOrder.top());
+            mVarOrder.pop();
+        }
+        mScopes.pop();
+    }
+
+    ArenaAllocator mAllocator{};
+    FoldStats mStats{};
+    bool mTerminated{}; // the current path has passed an `exit`
+    Env mVars{};
+    std::stack<std::string_view, std::vector<std::string_view>> mVarOrder{};
+    std::stack<size_t, std::vector<size_t>> mScopes{};
+};
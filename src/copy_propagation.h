@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdlib> // size_t
+#include <optional>
+#include <vector>
+
+#include "ir.h"
+
+// Replaces the uses of copies, and of phis whose arguments all agree, with their source and
+// deletes them. Needs SSA form, where a copy's source is available wherever its result is.
+class CopyPropagation {
+public:
+    CopyPropagation(const CopyPropagation &) = delete;
+    CopyPropagation &operator=(const CopyPropagation &) = delete;
+
+    CopyPropagation() = default;
+
+    void run(IrFunction &fn) {
+        for (bool changed{ true }; changed; ) {
+            mReplacement.assign(fn.vregCount, std::nullopt);
+            changed = false;
+
+            for (IrBlock &block : fn.blocks) {
+                for (const IrInstr &instr : block.instrs) {
+                    if (instr.op == IrOp::COPY) {
+                        changed = replace(instr.dst, instr.a) || changed;
+                    }
+                }
+                for (const IrPhi &phi : block.phis) {
+                    if (const std::optional<IrOperand> same{ commonArg(phi) }) {
+                        changed = replace(phi.dst, *same) || changed;
+                    }
+                }
+            }
+            if (!changed) {
+                break;
+            }
+
+            for (IrBlock &block : fn.blocks) {
+                std::erase_if(block.instrs, [this](const IrInstr &instr) { return mReplacement[instr.dst].has_value(); });
+                std::erase_if(block.phis, [this](const IrPhi &phi) { return mReplacement[phi.dst].has_value(); });
+                for (IrPhi &phi : block.phis) {
+                    for (IrOperand &arg : phi.args) {
+                        arg = resolve(arg);
+                    }
+                }
+                for (IrInstr &instr : block.instrs) {
+                    instr.a = resolve(instr.a);
+                    instr.b = resolve(instr.b);
+                }
+                block.term.value = resolve(block.term.value);
+            }
+        }
+    }
+
+private:
+    // The one argument of the phi besides the phi itself, if there is one
+    static std::optional<IrOperand> commonArg(const IrPhi &phi) {
+        std::optional<IrOperand> same{};
+        for (const IrOperand &arg : phi.args) {
+            if (arg == IrOperand::v(phi.dst) || arg == same) {
+                continue;
+            }
+            if (same || arg.kind == IrOperand::Kind::NONE) {
+                return std::nullopt;
+            }
+            same = arg;
+        }
+        return same;
+    }
+
+    // Records `vreg = value` unless it closes a cycle of copies
+    bool replace(const Vreg vreg, const IrOperand &value) {
+        if (resolve(value) == IrOperand::v(vreg)) {
+            return false;
+        }
+        mReplacement[vreg] = value;
+        return true;
+    }
+
+    // Follows chains of copies to the original value
+    IrOperand resolve(IrOperand operand) {
+        while (operand.isVreg() && mReplacement[operand.vreg()]) {
+            operand = *mReplacement[operand.vreg()];
+        }
+        return operand;
+    }
+
+    std::vector<std::optional<IrOperand>> mReplacement{};
+};
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <cstdlib> // size_t
+#include <stack>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility> // std::pair
+#include <variant> // std::visit, std::get_if
+#include <vector>
+
+#include "arena_allocator.h"
+#include "parser.h"
+
+struct DceStats {
+    size_t removedStmts{}; // statements after an `exit`
+    size_t prunedBranches{}; // `if`/`elif`/`else` branches and `while` loops decided by a literal condition
+    size_t removedLets{}; // `let` variables never read, with their assignments
+};
+
+// Removes code that can't run or whose result is never used:
+// - statements following one that always exits,
+// - branches whose literal condition is zero or that follow a branch whose literal
+//   condition is nonzero, which becomes the `else`,
+// - `while` loops whose literal condition is zero, and the statements following one whose
+//   literal condition is nonzero, as it never ends,
+// - `let` variables that are never read, together with their assignments, as long as none
+//   of their expressions may divide by zero.
+// Meant to run after constant folding, which leaves the literal conditions. Programs with
+// undeclared or redeclared names are left alone for the backends to report.
+class DeadCodeEliminator {
+public:
+    DeadCodeEliminator(const DeadCodeEliminator &) = delete;
+    DeadCodeEliminator &operator=(const DeadCodeEliminator &) = delete;
+
+    DeadCodeEliminator() = default;
+
+    // Repeats until nothing changes, as removing code can leave more variables unread
+    [[nodiscard]] const NodeProg *eliminate(const NodeProg *prog) {
+        for (bool changed{ true }; changed; ) {
+            if (!resolve(prog)) {
+                break;
+            }
+            markLive();
+
+            mChanged = false;
+            const ArenaAllocator::Mark sweep{ mAllocator.mark() };
+            NodeProg *const swept{ mAllocator.emplace<NodeProg>() };
+            bool exits{};
+            swept->stmts = sweepStmts(prog->stmts, exits);
+            changed = mChanged;
+            if (changed) {
+                prog = swept;
+            } else {
+                mAllocator.release(sweep); // a copy of the tree, with nothing removed
+            }
+        }
+
+        return prog;
+    }
+
+    [[nodiscard]] const DceStats &stats() const {
+        return mStats;
+    }
+
+    // Memory of the nodes it made
+    [[nodiscard]] ArenaStats arenaStats() const {
+        return mAllocator.stats();
+    }
+
+private:
+    // Helper type for the visitor
+    template<typename... Ts>
+    struct Visitor : Ts... {
+        using Ts::operator()...;
+    };
+
+    // Whether evaluating the expression can't trap, i.e. every divisor is a nonzero literal
+    static bool isPure(const NodeExpr *const expr) {
+        return std::visit(Visitor{
+
+            [](const NodeTerm *const term) {
+                if (const auto *const parenTerm{ std::get_if<const NodeTermParen *>(&term->term) }) {
+                    return isPure((*parenTerm)->expr);
+                }
+                return true;
+            },
+
+            [](const NodeBinExpr *const binExpr) {
+                if (const auto *const div{ std::get_if<const NodeBinExprDiv *>(&binExpr->expr) }) {
+                    const std::optional<uint64_t> divisor{ literalValue((*div)->rhs) };
+                    if (!divisor || *divisor == 0) {
+                        return false;
+                    }
+                }
+                return std::visit([](const auto *const bin) {
+                    return isPure(bin->lhs) && isPure(bin->rhs);
+                }, binExpr->expr);
+            },
+
+        }, expr->expr);
+    }
+
+    //=======================================================================
+    // Which variables are read
+
+    // Resolves every name to its `let`; false if some name doesn't resolve
+    bool resolve(const NodeProg *const prog) {
+        mReads.clear();
+        mLive.clear();
+        mAssignTargets.clear();
+        mWorklist.clear();
+        mValid = true;
+        mVars.clear();
+        for (const NodeStmt *const stmt : prog->stmts) {
+            resolveStmt(stmt);
+        }
+        while (!mVarOrder.empty()) {
+            mVarOrder.pop();
+        }
+        return mValid;
+    }
+
+    // Records the variables the expression reads on behalf of `reader`, or of live code if none
+    void resolveExpr(const NodeExpr *const expr, const NodeStmtLet *const reader) {
+        std::visit(Visitor{
+
+            [this, reader](const NodeTerm *const term) {
+                std::visit(Visitor{
+                    [](const NodeTermIntLiteral *const) {},
+                    [this, reader](const NodeTermIdentifier *const identifierTerm) {
+                        const auto it{ mVars.find(identifierTerm->identifier.name) };
+                        if (it == mVars.cend()) {
+                            mValid = false;
+                            return;
+                        }
+                        if (reader) {
+                            mReads[reader].push_back(it->second);
+                        } else {
+                            markLive(it->second);
+                        }
+                    },
+                    [this, reader](const NodeTermParen *const parenTerm) {
+                        resolveExpr(parenTerm->expr, reader);
+                    },
+                }, term->term);
+            },
+
+            [this, reader](const NodeBinExpr *const binExpr) {
+                std::visit([this, reader](const auto *const bin) {
+                    resolveExpr(bin->lhs, reader);
+                    resolveExpr(bin->rhs, reader);
+                }, binExpr->expr);
+            },
+
+        }, expr->expr);
+    }
+
+    void resolveScope(const NodeScope *const scope) {
+        const size_t depth{ mVarOrder.size() };
+        for (const NodeStmt *const stmt : scope->stmts) {
+            resolveStmt(stmt);
+        }
+        while (mVarOrder.size() > depth) {
+            mVars.erase(mVarOrder.top());
+            mVarOrder.pop();
+        }
+    }
+
+    void resolveStmt(const NodeStmt *const stmt) {
+        std::visit(Visitor{
+
+            [this](const NodeStmtExit *const exitStmt) {
+                resolveExpr(exitStmt->expr, nullptr);
+            },
+
+            [this](const NodeStmtLet *const letStmt) {
+                const std::string_view name{ letStmt->identifier.name };
+                if (mVars.contains(name)) {
+                    mValid = false;
+                    return;
+                }
+                resolveExpr(letStmt->expr, letStmt);
+                if (!isPure(letStmt->expr)) {
+                    markLive(letStmt);
+                }
+                mVars[name] = letStmt;
+                mVarOrder.push(name);
+            },
+
+            [this](const NodeStmtAssign *const assignStmt) {
+                const auto it{ mVars.find(assignStmt->identifier.name) };
+                if (it == mVars.cend()) {
+                    mValid = false;
+                    return;
+                }
+                mAssignTargets[assignStmt] = it->second;
+                resolveExpr(assignStmt->expr, it->second);
+                if (!isPure(assignStmt->expr)) {
+                    markLive(it->second);
+                }
+            },
+
+            [this](const NodeStmtIf *const ifStmt) {
+                resolveExpr(ifStmt->ifBranch->expr, nullptr);
+                resolveScope(ifStmt->ifBranch->scope);
+                for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
+                    resolveExpr(elifBranch->expr, nullptr);
+                    resolveScope(elifBranch->scope);
+                }
+                if (ifStmt->elseBranch) {
+                    resolveScope(ifStmt->elseBranch->scope);
+                }
+            },
+
+            [this](const NodeStmtWhile *const whileStmt) {
+                resolveExpr(whileStmt->expr, nullptr);
+                resolveScope(whileStmt->scope);
+            },
+
+            [this](const NodeScope *const scope) {
+                resolveScope(scope);
+            },
+
+        }, stmt->stmt);
+    }
+
+    void markLive(const NodeStmtLet *const letStmt) {
+        if (mLive.insert(letStmt).second) {
+            mWorklist.push_back(letStmt);
+        }
+    }
+
+    // A variable is live if live code reads it or a live variable's expressions do
+    void markLive() {
+        while (!mWorklist.empty()) {
+            const NodeStmtLet *const letStmt{ mWorklist.back() };
+            mWorklist.pop_back();
+            const auto it{ mReads.find(letStmt) };
+            if (it == mReads.cend()) {
+                continue;
+            }
+            for (const NodeStmtLet *const read : it->second) {
+                markLive(read);
+            }
+        }
+    }
+
+    //=======================================================================
+    // Rebuilding without the dead code
+
+    // `exits` tells whether the statements always end in an `exit`
+    std::vector<const NodeStmt *> sweepStmts(const std::vector<const NodeStmt *> &stmts, bool &exits) {
+        std::vector<const NodeStmt *> swept{};
+        for (const NodeStmt *const stmt : stmts) {
+            if (exits) {
+                ++mStats.removedStmts;
+                mChanged = true;
+                continue;
+            }
+            if (const NodeStmt *const kept{ sweepStmt(stmt, exits) }) {
+                swept.push_back(kept);
+            } else {
+                mChanged = true;
+            }
+        }
+        return swept;
+    }
+
+    const NodeScope *sweepScope(const NodeScope *const scope, bool &exits) {
+        NodeScope *const swept{ mAllocator.emplace<NodeScope>() };
+        swept->stmts = sweepStmts(scope->stmts, exits);
+        return swept;
+    }
+
+    // The statement to keep in place of `stmt`, or nothing
+    const NodeStmt *sweepStmt(const NodeStmt *const stmt, bool &exits) {
+        return std::visit(Visitor{
+
+            [&exits, stmt](const NodeStmtExit *const) -> const NodeStmt * {
+                exits = true;
+                return stmt;
+            },
+
+            [this, stmt](const NodeStmtLet *const letStmt) -> const NodeStmt * {
+                if (mLive.contains(letStmt)) {
+                    return stmt;
+                }
+                ++mStats.removedLets;
+                return nullptr;
+            },
+
+            [this, stmt](const NodeStmtAssign *const assignStmt) -> const NodeStmt * {
+                return mLive.contains(mAssignTargets.at(assignStmt)) ? stmt : nullptr;
+            },
+
+            [this, &exits](const NodeStmtIf *const ifStmt) -> const NodeStmt * {
+                return sweepIf(ifStmt, exits);
+            },
+
+            [this, &exits](const NodeStmtWhile *const whileStmt) -> const NodeStmt * {
+                return sweepWhile(whileStmt, exits);
+            },
+
+            [this, &exits](const NodeScope *const scope) -> const NodeStmt * {
+                const NodeScope *const swept{ sweepScope(scope, exits) };
+                if (swept->stmts.empty()) {
+                    return nullptr;
+                }
+                return mAllocator.emplace<NodeStmt>(swept);
+            },
+
+        }, stmt->stmt);
+    }
+
+    const NodeStmt *sweepIf(const NodeStmtIf *const ifStmt, bool &exits) {
+        std::vector<std::pair<const NodeExpr *, const NodeScope *>> branches{ { ifStmt->ifBranch->expr, ifStmt->ifBranch->scope } };
+        for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
+            branches.push_back({ elifBranch->expr, elifBranch->scope });
+        }
+        const NodeScope *elseScope{ ifStmt->elseBranch ? ifStmt->elseBranch->scope : nullptr };
+
+        // drop the branches that never run; a branch that always runs becomes the `else`
+        std::vector<std::pair<const NodeExpr *, const NodeScope *>> kept{};
+        for (size_t i{ 0 }; i < branches.size(); ++i) {
+            const std::optional<uint64_t> value{ literalValue(branches[i].first) };
+            if (!value) {
+                kept.push_back(branches[i]);
+                continue;
+            }
+            ++mStats.prunedBranches;
+            if (*value != 0) {
+                mStats.prunedBranches += branches.size() - i - 1 + (elseScope ? 1 : 0);
+                elseScope = branches[i].second;
+                break;
+            }
+        }
+        if (kept.size() != branches.size()) {
+            mChanged = true;
+        }
+
+        bool allExit{ true };
+        bool allEmpty{ true };
+        bool allPure{ true };
+        for (auto &[cond, scope] : kept) {
+            bool branchExits{};
+            scope = sweepScope(scope, branchExits);
+            allExit = allExit && branchExits;
+            allEmpty = allEmpty && scope->stmts.empty();
+            allPure = allPure && isPure(cond);
+        }
+        bool elseExits{};
+        if (elseScope) {
+            elseScope = sweepScope(elseScope, elseExits);
+            allEmpty = allEmpty && elseScope->stmts.empty();
+        }
+
+        if (kept.empty()) {
+            exits = elseExits;
+            return elseScope && !elseScope->stmts.empty() ? mAllocator.emplace<NodeStmt>(elseScope) : nullptr;
+        }
+        if (allEmpty && allPure) {
+            return nullptr;
+        }
+        exits = allExit && elseScope && elseExits;
+
+        NodeStmtIf *const swept{ mAllocator.emplace<NodeStmtIf>() };
+        swept->ifBranch = mAllocator.emplace<NodeBranchIf>(kept.front().first, kept.front().second);
+        for (size_t i{ 1 }; i < kept.size(); ++i) {
+            swept->elifBranches.push_back(mAllocator.emplace<NodeBranchElif>(kept[i].first, kept[i].second));
+        }
+        if (elseScope) {
+            swept->elseBranch = mAllocator.emplace<NodeBranchElse>(elseScope);
+        }
+        return mAllocator.emplace<NodeStmt>(swept);
+    }
+
+    // A loop that may not end is kept even if its body is empty
+    const NodeStmt *sweepWhile(const NodeStmtWhile *const whileStmt, bool &exits) {
+        const std::optional<uint64_t> value{ literalValue(whileStmt->expr) };
+        if (value && *value == 0) {
+            ++mStats.prunedBranches;
+            return nullptr;
+        }
+
+        bool bodyExits{};
+        const NodeScope *const scope{ sweepScope(whileStmt->scope, bodyExits) };
+        exits = value.has_value(); // no `break`, so only an `exit` leaves the loop
+        return mAllocator.emplace<NodeStmt>(mAllocator.emplace<NodeStmtWhile>(whileStmt->expr, scope));
+    }
+
+    ArenaAllocator mAllocator{};
+    DceStats mStats{};
+    bool mValid{}; // every name resolved
+    bool mChanged{};
+    std::unordered_map<const NodeStmtLet *, std::vector<const NodeStmtLet *>> mReads{}; // variables each one's expressions read
+    std::unordered_set<const NodeStmtLet *> mLive{};
+    std::vector<const NodeStmtLet *> mWorklist{};
+    std::unordered_map<const NodeStmtAssign *, const NodeStmtLet *> mAssignTargets{};
+    std::unordered_map<std::string_view, const NodeStmtLet *> mVars{};
+    std::stack<std::string_view, std::vector<std::string_view>> mVarOrder{};
+};
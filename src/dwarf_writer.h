@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint> // int8_t, int64_t, uint8_t, uint16_t, uint32_t, uint64_t
+#include <cstdlib> // size_t
+#include <string>
+#include <vector>
+
+#include "line_table.h"
+
+// The DWARF sections describing a program
+struct DebugSections {
+    std::vector<uint8_t> abbrev{}; // .debug_abbrev
+    std::vector<uint8_t> info{}; // .debug_info
+    std::vector<uint8_t> line{}; // .debug_line
+};
+
+// Writes a minimal DWARF 4 description of the code: one compile unit for the source file
+// and its line number program, enough for addr2line, gdb and perf to map addresses to lines.
+class DwarfWriter {
+public:
+    DwarfWriter(const DwarfWriter &) = delete;
+    DwarfWriter &operator=(const DwarfWriter &) = delete;
+
+    DwarfWriter() = default;
+
+    [[nodiscard]] DebugSections build(const std::string &source, const uint64_t address, const size_t codeSize, const std::vector<LineEntry> &entries) {
+        DebugSections sections{};
+
+        // one abbreviation: a compile unit without children
+        mOut = &sections.abbrev;
+        uleb(1);
+        uleb(DW_TAG_COMPILE_UNIT);
+        byte(DW_CHILDREN_NO);
+        uleb(DW_AT_NAME);
+        uleb(DW_FORM_STRING);
+        uleb(DW_AT_STMT_LIST);
+        uleb(DW_FORM_SEC_OFFSET);
+        uleb(DW_AT_LOW_PC);
+        uleb(DW_FORM_ADDR);
+        uleb(DW_AT_HIGH_PC);
+        uleb(DW_FORM_DATA8); // a length from DWARF 4 on
+        uleb(0);
+        uleb(0);
+        uleb(0);
+
+        mOut = &sections.info;
+        const size_t infoLength{ reserve32() };
+        u16(VERSION);
+        u32(0); // abbreviations offset
+        byte(sizeof(uint64_t)); // address size
+        uleb(1);
+        string(source);
+        u32(0); // line program offset
+        u64(address);
+        u64(codeSize);
+        patchLength(infoLength);
+
+        mOut = &sections.line;
+        const size_t lineLength{ reserve32() };
+        u16(VERSION);
+        const size_t headerLength{ reserve32() };
+        byte(1); // minimum instruction length
+        byte(1); // maximum operations per instruction
+        byte(1); // default is_stmt
+        byte(static_cast<uint8_t>(LINE_BASE));
+        byte(LINE_RANGE);
+        byte(OPCODE_BASE);
+        for (const uint8_t length : STANDARD_OPCODE_LENGTHS) {
+            byte(length);
+        }
+        byte(0); // no include directories
+        string(source);
+        uleb(0); // directory
+        uleb(0); // modification time
+        uleb(0); // length
+        byte(0); // end of the file names
+        patchLength(headerLength);
+
+        byte(0); // DW_LNE_set_address
+        uleb(1 + sizeof(uint64_t));
+        byte(DW_LNE_SET_ADDRESS);
+        u64(address);
+        size_t offset{};
+        int line{ 1 };
+        for (const LineEntry &entry : entries) {
+            byte(DW_LNS_ADVANCE_PC);
+            uleb(entry.offset - offset);
+            byte(DW_LNS_ADVANCE_LINE);
+            sleb(entry.line - line);
+            byte(DW_LNS_COPY);
+            offset = entry.offset;
+            line = entry.line;
+        }
+        byte(DW_LNS_ADVANCE_PC);
+        uleb(codeSize - offset);
+        byte(0); // DW_LNE_end_sequence
+        uleb(1);
+        byte(DW_LNE_END_SEQUENCE);
+        patchLength(lineLength);
+
+        return sections;
+    }
+
+private:
+    static constexpr uint16_t VERSION{ 4 };
+    static constexpr uint8_t DW_TAG_COMPILE_UNIT{ 0x11 };
+    static constexpr uint8_t DW_CHILDREN_NO{ 0 };
+    static constexpr uint8_t DW_AT_NAME{ 0x03 };
+    static constexpr uint8_t DW_AT_STMT_LIST{ 0x10 };
+    static constexpr uint8_t DW_AT_LOW_PC{ 0x11 };
+    static constexpr uint8_t DW_AT_HIGH_PC{ 0x12 };
+    static constexpr uint8_t DW_FORM_ADDR{ 0x01 };
+    static constexpr uint8_t DW_FORM_DATA8{ 0x07 };
+    static constexpr uint8_t DW_FORM_STRING{ 0x08 };
+    static constexpr uint8_t DW_FORM_SEC_OFFSET{ 0x17 };
+    static constexpr uint8_t DW_LNS_COPY{ 0x01 };
+    static constexpr uint8_t DW_LNS_ADVANCE_PC{ 0x02 };
+    static constexpr uint8_t DW_LNS_ADVANCE_LINE{ 0x03 };
+    static constexpr uint8_t DW_LNE_END_SEQUENCE{ 0x01 };
+    static constexpr uint8_t DW_LNE_SET_ADDRESS{ 0x02 };
+    static constexpr int8_t LINE_BASE{ -5 };
+    static constexpr uint8_t LINE_RANGE{ 14 };
+    static constexpr uint8_t OPCODE_BASE{ 13 };
+    static constexpr uint8_t STANDARD_OPCODE_LENGTHS[OPCODE_BASE - 1]{ 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 };
+
+    void byte(const uint8_t value) {
+        mOut->push_back(value);
+    }
+
+    void u16(const uint16_t value) {
+        byte(static_cast<uint8_t>(value));
+        byte(static_cast<uint8_t>(value >> 8));
+    }
+
+    void u32(const uint32_t value) {
+        for (size_t i{ 0 }; i < sizeof(value); ++i) {
+            byte(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void u64(const uint64_t value) {
+        for (size_t i{ 0 }; i < sizeof(value); ++i) {
+            byte(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void uleb(uint64_t value) {
+        do {
+            const uint8_t low{ static_cast<uint8_t>(value & 0x7f) };
+            value >>= 7;
+            byte(value != 0 ? low | 0x80 : low);
+        } while (value != 0);
+    }
+
+    void sleb(int64_t value) {
+        for (bool more{ true }; more; ) {
+            const uint8_t low{ static_cast<uint8_t>(value & 0x7f) };
+            value >>= 7; // arithmetic
+            more = !((value == 0 && !(low & 0x40)) || (value == -1 && (low & 0x40)));
+            byte(more ? low | 0x80 : low);
+        }
+    }
+
+    void string(const std::string &value) {
+        mOut->insert(mOut->end(), value.cbegin(), value.cend());
+        byte(0);
+    }
+
+    // Position of a 32-bit length to patch once what follows it is written
+    size_t reserve32() {
+        const size_t pos{ mOut->size() };
+        u32(0);
+        return pos;
+    }
+
+    void patchLength(const size_t pos) {
+        const uint32_t length{ static_cast<uint32_t>(mOut->size() - pos - sizeof(uint32_t)) };
+        for (size_t i{ 0 }; i < sizeof(length); ++i) {
+            (*mOut)[pos + i] = static_cast<uint8_t>(length >> (8 * i));
+        }
+    }
+
+    std::vector<uint8_t> *mOut{};
+};
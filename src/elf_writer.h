@@ -0,0 +1,163 @@
+#pragma once
+
+#include <elf.h>
+
+#include <cstdint> // uint8_t, uint64_t
+#include <cstdlib> // size_t
+#include <cstring> // std::memcpy
+#include <string>
+#include <vector>
+
+#include "dwarf_writer.h"
+#include "line_table.h"
+
+// Builds a static ELF64 executable with a single R+X segment holding the headers and the code.
+// Sections that aren't loaded follow it: a symbol per stretch of code of a source line, named
+// like `test.code:12`, and a DWARF line table, so profilers and debuggers can tell which line
+// an address belongs to.
+class ElfWriter {
+public:
+    ElfWriter(const ElfWriter &) = delete;
+    ElfWriter &operator=(const ElfWriter &) = delete;
+
+    ElfWriter() = default;
+
+    static constexpr uint64_t BASE_ADDRESS{ 0x400000 };
+    static constexpr uint64_t PAGE_SIZE{ 0x1000 };
+    static constexpr uint64_t CODE_OFFSET{ sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr) };
+    static constexpr uint64_t ENTRY_ADDRESS{ BASE_ADDRESS + CODE_OFFSET };
+
+    [[nodiscard]] std::vector<uint8_t> build(
+        const std::vector<uint8_t> &code,
+        const std::string &source,
+        const std::vector<LineEntry> &lines
+    ) const {
+        const uint64_t loadedSize{ CODE_OFFSET + code.size() };
+
+        Elf64_Ehdr header{};
+        header.e_ident[EI_MAG0] = ELFMAG0;
+        header.e_ident[EI_MAG1] = ELFMAG1;
+        header.e_ident[EI_MAG2] = ELFMAG2;
+        header.e_ident[EI_MAG3] = ELFMAG3;
+        header.e_ident[EI_CLASS] = ELFCLASS64;
+        header.e_ident[EI_DATA] = ELFDATA2LSB;
+        header.e_ident[EI_VERSION] = EV_CURRENT;
+        header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+        header.e_type = ET_EXEC;
+        header.e_machine = EM_X86_64;
+        header.e_version = EV_CURRENT;
+        header.e_entry = ENTRY_ADDRESS;
+        header.e_phoff = sizeof(Elf64_Ehdr);
+        header.e_ehsize = sizeof(Elf64_Ehdr);
+        header.e_phentsize = sizeof(Elf64_Phdr);
+        header.e_phnum = 1;
+        header.e_shentsize = sizeof(Elf64_Shdr);
+
+        Elf64_Phdr text{};
+        text.p_type = PT_LOAD;
+        text.p_flags = PF_R | PF_X;
+        text.p_offset = 0;
+        text.p_vaddr = BASE_ADDRESS;
+        text.p_paddr = BASE_ADDRESS;
+        text.p_filesz = loadedSize;
+        text.p_memsz = loadedSize;
+        text.p_align = PAGE_SIZE;
+
+        std::vector<uint8_t> image(loadedSize);
+        std::memcpy(image.data() + sizeof(header), &text, sizeof(text));
+        std::memcpy(image.data() + CODE_OFFSET, code.data(), code.size());
+
+        // symbols: the local ones of the lines, then the entry point
+        std::vector<uint8_t> strtab{ 0 };
+        std::vector<Elf64_Sym> symbols(1);
+        const std::vector<LineRegion> regions{ lineRegions(lines, code.size()) };
+        for (const LineRegion &region : regions) {
+            if (region.line != 0) {
+                symbols.push_back(symbol(strtab, regionName(source, region.line), STB_LOCAL, region.start, region.size));
+            }
+        }
+        const size_t firstGlobal{ symbols.size() };
+        const size_t entrySize{ !regions.empty() && regions.front().line == 0 ? regions.front().size : 0 };
+        symbols.push_back(symbol(strtab, regionName(source, 0), STB_GLOBAL, 0, entrySize));
+
+        DwarfWriter dwarfWriter{};
+        const DebugSections debug{ dwarfWriter.build(source, ENTRY_ADDRESS, code.size(), lines) };
+
+        std::vector<uint8_t> shstrtab{ 0 };
+        std::vector<Elf64_Shdr> sections(1);
+        Elf64_Shdr textSection{ section(shstrtab, ".text", SHT_PROGBITS, CODE_OFFSET, code.size()) };
+        textSection.sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+        textSection.sh_addr = ENTRY_ADDRESS;
+        textSection.sh_addralign = 1;
+        sections.push_back(textSection);
+
+        const size_t symtabIndex{ sections.size() };
+        alignTo8(image);
+        Elf64_Shdr symtabSection{ append(image, shstrtab, ".symtab", SHT_SYMTAB, symbols.data(), symbols.size() * sizeof(Elf64_Sym)) };
+        symtabSection.sh_link = static_cast<uint32_t>(symtabIndex + 1);
+        symtabSection.sh_info = static_cast<uint32_t>(firstGlobal);
+        symtabSection.sh_entsize = sizeof(Elf64_Sym);
+        symtabSection.sh_addralign = sizeof(uint64_t);
+        sections.push_back(symtabSection);
+        sections.push_back(append(image, shstrtab, ".strtab", SHT_STRTAB, strtab.data(), strtab.size()));
+        sections.push_back(append(image, shstrtab, ".debug_abbrev", SHT_PROGBITS, debug.abbrev.data(), debug.abbrev.size()));
+        sections.push_back(append(image, shstrtab, ".debug_info", SHT_PROGBITS, debug.info.data(), debug.info.size()));
+        sections.push_back(append(image, shstrtab, ".debug_line", SHT_PROGBITS, debug.line.data(), debug.line.size()));
+        header.e_shstrndx = static_cast<uint16_t>(sections.size());
+        Elf64_Shdr shstrtabSection{ section(shstrtab, ".shstrtab", SHT_STRTAB, image.size(), 0) };
+        shstrtabSection.sh_size = shstrtab.size(); // with its own name
+        image.insert(image.end(), shstrtab.cbegin(), shstrtab.cend());
+        sections.push_back(shstrtabSection);
+
+        alignTo8(image);
+        header.e_shoff = image.size();
+        header.e_shnum = static_cast<uint16_t>(sections.size());
+        const size_t headersPos{ image.size() };
+        image.resize(headersPos + sections.size() * sizeof(Elf64_Shdr));
+        std::memcpy(image.data() + headersPos, sections.data(), sections.size() * sizeof(Elf64_Shdr));
+        std::memcpy(image.data(), &header, sizeof(header));
+
+        return image;
+    }
+
+private:
+    static void alignTo8(std::vector<uint8_t> &image) {
+        image.resize((image.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t));
+    }
+
+    // Offset of the name in the string table
+    static size_t name(std::vector<uint8_t> &strtab, const std::string &value) {
+        const size_t offset{ strtab.size() };
+        strtab.insert(strtab.end(), value.cbegin(), value.cend());
+        strtab.push_back(0);
+        return offset;
+    }
+
+    static Elf64_Sym symbol(std::vector<uint8_t> &strtab, const std::string &value, const uint8_t binding, const size_t offset, const size_t size) {
+        Elf64_Sym sym{};
+        sym.st_name = static_cast<uint32_t>(name(strtab, value));
+        sym.st_info = ELF64_ST_INFO(binding, STT_FUNC);
+        sym.st_shndx = 1; // .text
+        sym.st_value = ENTRY_ADDRESS + offset;
+        sym.st_size = size;
+        return sym;
+    }
+
+    static Elf64_Shdr section(std::vector<uint8_t> &shstrtab, const std::string &value, const uint32_t type, const uint64_t offset, const uint64_t size) {
+        Elf64_Shdr shdr{};
+        shdr.sh_name = static_cast<uint32_t>(name(shstrtab, value));
+        shdr.sh_type = type;
+        shdr.sh_offset = offset;
+        shdr.sh_size = size;
+        shdr.sh_addralign = 1;
+        return shdr;
+    }
+
+    // Section with the contents appended to the image
+    static Elf64_Shdr append(std::vector<uint8_t> &image, std::vector<uint8_t> &shstrtab, const std::string &value, const uint32_t type, const void *const data, const size_t size) {
+        const size_t offset{ image.size() };
+        image.resize(offset + size);
+        std::memcpy(image.data() + offset, data, size);
+        return section(shstrtab, value, type, offset, size);
+    }
+};
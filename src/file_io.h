@@ -0,0 +1,124 @@
+#pragma once
+
+#include <fcntl.h> // open, O_RDONLY, O_WRONLY, O_CREAT, O_TRUNC
+#include <sys/mman.h> // mmap, munmap, madvise
+#include <sys/stat.h> // fstat, fchmod
+#include <sys/uio.h> // writev, iovec
+#include <unistd.h> // close
+
+#include <algorithm> // std::min
+#include <cerrno> // errno, EINTR
+#include <cstdlib> // size_t
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "error.h"
+
+// A file mapped read-only into memory, so the tokenizer scans the page cache in place
+class MappedFile {
+public:
+    MappedFile() = delete;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    explicit MappedFile(const char *const path) {
+        const int fd{ open(path, O_RDONLY) };
+        struct stat info{};
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            error("Cannot read " + std::string(path));
+        }
+        mSize = static_cast<size_t>(info.st_size);
+        if (mSize > 0) { // an empty file can't be mapped
+            void *const data{ mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0) };
+            if (data == MAP_FAILED) {
+                error("Cannot read " + std::string(path));
+            }
+            madvise(data, mSize, MADV_SEQUENTIAL);
+            mData = static_cast<const char *>(data);
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (mData) {
+            munmap(const_cast<char *>(mData), mSize);
+        }
+    }
+
+    [[nodiscard]] std::string_view contents() const {
+        return { mData, mSize };
+    }
+
+private:
+    const char *mData{};
+    size_t mSize{};
+};
+
+// Writes a file through one reusable buffer; pieces that don't fit go out together with
+// the buffered bytes in a single `writev`
+class FileWriter {
+public:
+    FileWriter() = delete;
+    FileWriter(const FileWriter &) = delete;
+    FileWriter &operator=(const FileWriter &) = delete;
+
+    explicit FileWriter(const char *const path, const mode_t mode = 0644) :
+        mPath{ path },
+        mFd{ open(path, O_WRONLY | O_CREAT | O_TRUNC, mode) } {
+        if (mFd < 0 || fchmod(mFd, mode) != 0) { // `open` applies the umask
+            error("Cannot write " + mPath);
+        }
+        mBuffer.reserve(BUFFER_SIZE);
+    }
+
+    ~FileWriter() {
+        flush();
+        close(mFd);
+    }
+
+    void write(const std::string_view data) {
+        if (mBuffer.size() + data.size() <= BUFFER_SIZE) {
+            mBuffer.insert(mBuffer.end(), data.cbegin(), data.cend());
+            return;
+        }
+        writeAll(data);
+    }
+
+    void write(const void *const data, const size_t size) {
+        write({ static_cast<const char *>(data), size });
+    }
+
+    void flush() {
+        writeAll({});
+    }
+
+private:
+    static constexpr size_t BUFFER_SIZE{ 1 << 20 };
+
+    // Writes the buffer followed by `data`, resuming after short writes
+    void writeAll(std::string_view data) {
+        std::string_view buffered{ mBuffer.data(), mBuffer.size() };
+        while (!buffered.empty() || !data.empty()) {
+            iovec parts[]{
+                { const_cast<char *>(buffered.data()), buffered.size() },
+                { const_cast<char *>(data.data()), data.size() },
+            };
+            const ssize_t written{ writev(mFd, parts, 2) };
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error("Cannot write " + mPath);
+            }
+            const size_t fromBuffer{ std::min(static_cast<size_t>(written), buffered.size()) };
+            buffered.remove_prefix(fromBuffer);
+            data.remove_prefix(static_cast<size_t>(written) - fromBuffer);
+        }
+        mBuffer.clear();
+    }
+
+    std::string mPath{};
+    int mFd{};
+    std::vector<char> mBuffer{};
+};
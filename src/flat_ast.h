@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstddef> // std::ptrdiff_t
+#include <cstdint> // uint8_t, uint32_t, uint64_t
+#include <cstdlib> // size_t
+#include <string_view>
+#include <utility> // std::move
+#include <variant> // std::visit, std::get_if
+#include <vector>
+
+#include "parser.h"
+
+// The AST as one array of 16-byte nodes in post-order: every node comes after its children,
+// so the root is last and a pass that needs the children's results first is a single loop
+// over the array. Nodes refer to each other by 32-bit index and are told apart by their
+// kind, so traversals switch on it instead of visiting variants and chasing pointers.
+enum class NodeKind : uint8_t {
+    INT_LITERAL, // a: index into `literals`
+    IDENTIFIER, // a: index into `names`
+    PAREN, // a: the expression
+    ADD, SUB, MUL, DIV, // a: lhs, b: rhs
+    EXIT, // a: the expression
+    LET, ASSIGN, // a: index into `names`, b: the expression
+    IF, // children a..a+b in `children`: condition and scope of each branch, then the `else` scope if any
+    WHILE, // a: the condition, b: the scope
+    SCOPE, PROG, // children a..a+b in `children`: the statements
+};
+
+using NodeIndex = uint32_t;
+
+struct FlatNode {
+    NodeKind kind{};
+    int line{}; // of the leftmost token of an expression, or of a statement's name
+    NodeIndex a{};
+    NodeIndex b{};
+};
+static_assert(sizeof(FlatNode) == 16);
+
+struct FlatAst {
+    std::vector<FlatNode> nodes{};
+    std::vector<NodeIndex> children{}; // of the nodes with lists, each list contiguous
+    std::vector<uint64_t> literals{};
+    std::vector<std::string_view> names{};
+
+    [[nodiscard]] NodeIndex root() const {
+        return static_cast<NodeIndex>(nodes.size() - 1);
+    }
+
+    [[nodiscard]] const FlatNode &operator[](const NodeIndex index) const {
+        return nodes[index];
+    }
+
+    [[nodiscard]] const NodeIndex *childrenOf(const FlatNode &node) const {
+        return children.data() + node.a;
+    }
+
+    // Heap bytes held by the arrays
+    [[nodiscard]] size_t bytes() const {
+        return nodes.capacity() * sizeof(FlatNode) + children.capacity() * sizeof(NodeIndex)
+            + literals.capacity() * sizeof(uint64_t) + names.capacity() * sizeof(std::string_view);
+    }
+};
+
+// Lays out a pointer-based tree as a FlatAst
+class AstFlattener {
+public:
+    AstFlattener(const AstFlattener &) = delete;
+    AstFlattener &operator=(const AstFlattener &) = delete;
+
+    AstFlattener() = default;
+
+    [[nodiscard]] FlatAst flatten(const NodeProg *const prog) {
+        mAst = {};
+        const size_t first{ mPending.size() };
+        flattenStmts(prog->stmts);
+        add({ .kind = NodeKind::PROG, .a = addChildren(first), .b = static_cast<NodeIndex>(prog->stmts.size()) });
+        return std::move(mAst);
+    }
+
+private:
+    // Helper type for the visitor
+    template<typename... Ts>
+    struct Visitor : Ts... {
+        using Ts::operator()...;
+    };
+
+    NodeIndex add(const FlatNode &node) {
+        mAst.nodes.push_back(node);
+        return static_cast<NodeIndex>(mAst.nodes.size() - 1);
+    }
+
+    // Moves the pending children from `first` on into `children`, as one list
+    NodeIndex addChildren(const size_t first) {
+        const NodeIndex start{ static_cast<NodeIndex>(mAst.children.size()) };
+        mAst.children.insert(mAst.children.end(), mPending.cbegin() + static_cast<std::ptrdiff_t>(first), mPending.cend());
+        mPending.resize(first);
+        return start;
+    }
+
+    NodeIndex addName(const std::string_view name) {
+        mAst.names.push_back(name);
+        return static_cast<NodeIndex>(mAst.names.size() - 1);
+    }
+
+    NodeIndex flattenExpr(const NodeExpr *const expr) {
+        return std::visit(Visitor{
+
+            [this](const NodeTerm *const term) {
+                return std::visit(Visitor{
+                    [this](const NodeTermIntLiteral *const intLiteralTerm) {
+                        mAst.literals.push_back(intLiteralTerm->value);
+                        return add({ .kind = NodeKind::INT_LITERAL, .line = intLiteralTerm->ln, .a = static_cast<NodeIndex>(mAst.literals.size() - 1) });
+                    },
+                    [this](const NodeTermIdentifier *const identifierTerm) {
+                        return add({ .kind = NodeKind::IDENTIFIER, .line = identifierTerm->identifier.ln, .a = addName(identifierTerm->identifier.name) });
+                    },
+                    [this](const NodeTermParen *const parenTerm) {
+                        const NodeIndex inner{ flattenExpr(parenTerm->expr) };
+                        return add({ .kind = NodeKind::PAREN, .line = mAst.nodes[inner].line, .a = inner });
+                    },
+                }, term->term);
+            },
+
+            [this](const NodeBinExpr *const binExpr) {
+                return std::visit([this](const auto *const bin) {
+                    const NodeIndex lhs{ flattenExpr(bin->lhs) };
+                    const NodeIndex rhs{ flattenExpr(bin->rhs) };
+                    return add({ .kind = binKind(bin), .line = mAst.nodes[lhs].line, .a = lhs, .b = rhs });
+                }, binExpr->expr);
+            },
+
+        }, expr->expr);
+    }
+
+    static NodeKind binKind(const NodeBinExprAdd *const) { return NodeKind::ADD; }
+    static NodeKind binKind(const NodeBinExprSub *const) { return NodeKind::SUB; }
+    static NodeKind binKind(const NodeBinExprMul *const) { return NodeKind::MUL; }
+    static NodeKind binKind(const NodeBinExprDiv *const) { return NodeKind::DIV; }
+
+    NodeIndex flattenScope(const NodeScope *const scope) {
+        const size_t first{ mPending.size() };
+        flattenStmts(scope->stmts);
+        return add({ .kind = NodeKind::SCOPE, .a = addChildren(first), .b = static_cast<NodeIndex>(scope->stmts.size()) });
+    }
+
+    void flattenStmts(const std::vector<const NodeStmt *> &stmts) {
+        for (const NodeStmt *const stmt : stmts) {
+            const NodeIndex index{ flattenStmt(stmt) };
+            mPending.push_back(index);
+        }
+    }
+
+    NodeIndex flattenStmt(const NodeStmt *const stmt) {
+        return std::visit(Visitor{
+
+            [this](const NodeStmtExit *const exitStmt) {
+                const NodeIndex expr{ flattenExpr(exitStmt->expr) };
+                return add({ .kind = NodeKind::EXIT, .line = mAst.nodes[expr].line, .a = expr });
+            },
+
+            [this](const NodeStmtLet *const letStmt) {
+                const NodeIndex expr{ flattenExpr(letStmt->expr) };
+                return add({ .kind = NodeKind::LET, .line = letStmt->identifier.ln, .a = addName(letStmt->identifier.name), .b = expr });
+            },
+
+            [this](const NodeStmtAssign *const assignStmt) {
+                const NodeIndex expr{ flattenExpr(assignStmt->expr) };
+                return add({ .kind = NodeKind::ASSIGN, .line = assignStmt->identifier.ln, .a = addName(assignStmt->identifier.name), .b = expr });
+            },
+
+            [this](const NodeStmtIf *const ifStmt) {
+                const size_t first{ mPending.size() };
+                const auto branch{ [this](const NodeIndex index) { mPending.push_back(index); } };
+                branch(flattenExpr(ifStmt->ifBranch->expr));
+                branch(flattenScope(ifStmt->ifBranch->scope));
+                for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
+                    branch(flattenExpr(elifBranch->expr));
+                    branch(flattenScope(elifBranch->scope));
+                }
+                if (ifStmt->elseBranch) {
+                    branch(flattenScope(ifStmt->elseBranch->scope));
+                }
+                const int line{ mAst.nodes[mPending[first]].line };
+                const NodeIndex count{ static_cast<NodeIndex>(mPending.size() - first) };
+                return add({ .kind = NodeKind::IF, .line = line, .a = addChildren(first), .b = count });
+            },
+
+            [this](const NodeStmtWhile *const whileStmt) {
+                const NodeIndex cond{ flattenExpr(whileStmt->expr) };
+                const NodeIndex scope{ flattenScope(whileStmt->scope) };
+                return add({ .kind = NodeKind::WHILE, .line = mAst.nodes[cond].line, .a = cond, .b = scope });
+            },
+
+            [this](const NodeScope *const scope) {
+                return flattenScope(scope);
+            },
+
+        }, stmt->stmt);
+    }
+
+    FlatAst mAst{};
+    std::vector<NodeIndex> mPending{}; // children of the lists being flattened, innermost last
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm> // std::sort
+#include <cstdlib> // size_t
+#include <functional> // std::greater
+#include <numeric> // std::iota
+#include <queue>
+#include <vector>
+
+#include "linear_scan.h"
+
+// Lays out the stack slots of the spilled values in one frame. A value takes the lowest
+// slot that is free when its interval starts, so values that are never live at the same
+// time, like those of sibling scopes, share a slot and the frame only has as many slots as
+// values live at once.
+class FrameLayout {
+public:
+    FrameLayout(const FrameLayout &) = delete;
+    FrameLayout &operator=(const FrameLayout &) = delete;
+
+    FrameLayout() = default;
+
+    // Returns a slot per interval
+    [[nodiscard]] std::vector<size_t> assign(const std::vector<LiveInterval> &intervals) {
+        std::vector<size_t> slots(intervals.size());
+        std::vector<size_t> order(intervals.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&intervals](const size_t a, const size_t b) {
+            return intervals[a].start < intervals[b].start;
+        });
+
+        std::priority_queue<size_t, std::vector<size_t>, std::greater<>> freeSlots{};
+        std::vector<size_t> active{};
+        mSlotCount = 0;
+
+        for (const size_t current : order) {
+            std::erase_if(active, [&](const size_t other) {
+                if (intervals[other].end < intervals[current].start) {
+                    freeSlots.push(slots[other]);
+                    return true;
+                }
+                return false;
+            });
+
+            if (freeSlots.empty()) {
+                slots[current] = mSlotCount++;
+            } else {
+                slots[current] = freeSlots.top();
+                freeSlots.pop();
+            }
+            active.push_back(current);
+        }
+
+        return slots;
+    }
+
+    [[nodiscard]] size_t slotCount() const {
+        return mSlotCount;
+    }
+
+private:
+    size_t mSlotCount{};
+};
@@ -1,18 +1,44 @@
 #pragma once
 
+#include <algorithm> // std::find, std::min, std::max, std::swap
+#include <cstdint> // int32_t, int64_t, uint64_t
 #include <cstdlib> // size_t
-#include <sstream>
-#include <stack>
+#include <cstring> // std::memcpy
+#include <iterator> // std::begin, std::end
+#include <limits>
+#include <optional>
 #include <string>
-#include <unordered_map>
-#include <variant> // std::visit
+#include <utility> // std::move
+#include <vector>
 
-#include "error.h"
-#include "not_implemented_error.h"
-#include "parser.h"
+#include "frame_layout.h"
+#include "instruction_selector.h"
+#include "ir.h"
+#include "ir_liveness.h"
+#include "linear_scan.h"
+#include "x86.h"
 
 constexpr int EIGHT_BYTES{ 8 };
+constexpr int64_t SYS_WRITE{ 1 };
+constexpr int64_t SYS_OPEN{ 2 };
+constexpr int64_t SYS_CLOSE{ 3 };
+constexpr int64_t SYS_EXIT{ 60 };
+constexpr int64_t PROFILE_OPEN_FLAGS{ 01 | 0100 | 01000 }; // O_WRONLY | O_CREAT | O_TRUNC
+constexpr int64_t PROFILE_MODE{ 0644 };
+
+// How the program hands its exit value back
+enum class ExitMode {
+    SYSCALL, // `exit` system call from a standalone executable
+    RETURN, // return to the caller as a function (JIT)
+};
 
+// Emits x86-64 for an IR function out of SSA form, following the tiles the instruction
+// selector chose. Virtual registers are given machine registers by linear scan over their
+// live intervals; the ones left over live in stack slots below rbp, shared between values
+// that aren't live at the same time. With a profile, a use counts as often as its block ran
+// when choosing what to spill. An instrumented function keeps its profile counters below
+// the stack slots, and every exit first writes them to the profile file. A line marker goes
+// in front of the code of each source line.
 class Generator {
 public:
     Generator(const Generator &) = delete;
@@ -20,278 +46,509 @@ public:
 
     Generator() = default;
 
-    void genTerm(const NodeTerm *const term) {
-        std::visit(Visitor{
+    explicit Generator(const ExitMode exitMode) : mExitMode{ exitMode } {}
 
-            [this](const NodeTermIntLiteral *const intLiteralTerm) {
-                instruction("mov", "rax", intLiteralTerm->intLiteral.value.value());
-                push("rax");
-            },
+    Generator(const ExitMode exitMode, std::string profilePath) :
+        mExitMode{ exitMode }, mProfilePath{ std::move(profilePath) } {}
 
-            [this](const NodeTermIdentifier *const identifierTerm) {
-                if (!mVars.contains(identifierTerm->identifier.value.value())) {
-                    error("Undeclared variable: " + identifierTerm->identifier.value.value());
-                }
-                const Var &var{ mVars[identifierTerm->identifier.value.value()] };
-                push("QWORD [rsp + " + std::to_string(EIGHT_BYTES*(mStackLoc-var.stackLoc-1)) + "]");
-            },
+    [[nodiscard]] InstrList genProg(const IrFunction &fn) {
+        InstructionSelector selector{};
+        mTiles = selector.select(fn);
+        allocate(fn);
+        mCounterCount = fn.counterCount;
+        mEpilogueLabel = fn.blocks.size();
+        mDumpLabel = fn.blocks.size() + 1;
 
-            [this](const NodeTermParen *const parenTerm) {
-                genExpr(parenTerm->expr);
-            }
+        genPrologue();
 
-        }, term->term);
-    }
+        for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+            insertLabel(b);
+            genBlock(fn.blocks[b], mTiles[b], b + 1);
+        }
+
+        if (mCounterCount > 0) {
+            genDump();
+        }
+        if (mExitMode == ExitMode::RETURN) {
+            genEpilogue();
+        }
 
-    void genBinExpr(const NodeBinExpr *const binExpr) {
-        std::visit(Visitor{
-
-            [this](const NodeBinExprAdd *const binExprAdd){
-                genExpr(binExprAdd->lhs);
-                genExpr(binExprAdd->rhs);
-                pop("rbx");
-                pop("rax");
-                instruction("add", "rax", "rbx");
-                push("rax");
-            },
-
-            [this](const NodeBinExprSub *const binExprSub){
-                genExpr(binExprSub->lhs);
-                genExpr(binExprSub->rhs);
-                pop("rbx");
-                pop("rax");
-                instruction("sub", "rax", "rbx");
-                push("rax");
-            },
-
-            [this](const NodeBinExprMul *const binExprMul){
-                genExpr(binExprMul->lhs);
-                genExpr(binExprMul->rhs);
-                pop("rbx");
-                pop("rax");
-                instruction("mul", "rbx");
-                push("rax");
-            },
-
-            [this](const NodeBinExprDiv *const binExprDiv){
-                genExpr(binExprDiv->lhs);
-                genExpr(binExprDiv->rhs);
-                pop("rbx");
-                pop("rax");
-                instruction("div", "rbx");
-                push("rax");
-            },
-
-        }, binExpr->expr);
+        return std::move(mInstrs);
     }
 
-    void genExpr(const NodeExpr *const expr) {
-        std::visit(Visitor{
+private:
+    // Registers handed to virtual registers, caller-saved first so a JIT function saves less.
+    // rax and rdx are kept free for `div` and `mul`, r11 for moves between memory operands.
+    static constexpr Reg ALLOC_REGS[]{
+        Reg::RCX, Reg::RSI, Reg::RDI, Reg::R8, Reg::R9, Reg::R10,
+        Reg::RBX, Reg::R12, Reg::R13, Reg::R14, Reg::R15,
+    };
+    static constexpr Reg CALLEE_SAVED[]{ Reg::RBX, Reg::R12, Reg::R13, Reg::R14, Reg::R15 };
+    static constexpr Reg SCRATCH{ Reg::R11 };
+
+    static bool fitsInt32(const Operand &operand) {
+        return operand.kind != Operand::Kind::IMM || (
+            operand.imm >= std::numeric_limits<int32_t>::min() &&
+            operand.imm <= std::numeric_limits<int32_t>::max()
+        );
+    }
 
-            [this](const NodeTerm *const term) {
-                genTerm(term);
-            },
+    // Live intervals over a numbering with two points per tile: operands are read at the even
+    // point and the result written at the odd one, so a result may take the register of an
+    // operand that dies there. Instructions inside a tile have no result of their own.
+    void allocate(const IrFunction &fn) {
+        IrLiveness liveness{};
+        const IrLiveSets live{ liveness.analyze(fn) };
+
+        std::vector<LiveInterval> intervals(fn.vregCount, { .start = std::numeric_limits<size_t>::max() });
+        size_t useWeight{ 1 };
+        const auto touch{ [&intervals, &useWeight](const Vreg vreg, const size_t point) {
+            LiveInterval &interval{ intervals[vreg] };
+            interval.start = std::min(interval.start, point);
+            interval.end = std::max(interval.end, point);
+            interval.weight += useWeight;
+        } };
+        const auto touchOperand{ [&touch](const IrOperand &operand, const size_t point) {
+            if (operand.isVreg()) {
+                touch(operand.vreg(), point);
+            }
+        } };
+
+        size_t point{};
+        for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+            const IrBlock &block{ fn.blocks[b] };
+            useWeight = fn.profiled ? static_cast<size_t>(std::max<uint64_t>(block.count, 1)) : 1;
+            for (const Vreg vreg : live.liveInList(b)) {
+                touch(vreg, point);
+            }
+            for (size_t i{ 0 }; i < block.instrs.size(); ++i) {
+                const IrInstr &instr{ block.instrs[i] };
+                touchOperand(instr.a, point);
+                touchOperand(instr.b, point);
+                if (mTiles[b][i] == Tile::COVERED || mTiles[b][i] == Tile::COMPARE) {
+                    continue;
+                }
+                touch(instr.dst, point + 1);
+                point += 2;
+            }
+            touchOperand(block.term.value, point);
+            for (const Vreg vreg : live.liveOutList(b)) {
+                touch(vreg, point + 1);
+            }
+            point += 2;
+        }
 
-            [this](const NodeBinExpr *const binExpr) {
-                genBinExpr(binExpr);
-            },
+        // registers that are never used don't take part
+        std::vector<Vreg> used{};
+        std::vector<LiveInterval> usedIntervals{};
+        for (Vreg vreg{ 0 }; vreg < fn.vregCount; ++vreg) {
+            if (intervals[vreg].weight > 0) {
+                used.push_back(vreg);
+                usedIntervals.push_back(intervals[vreg]);
+            }
+        }
 
-        }, expr->expr);
-    }
+        LinearScan allocator{ { std::begin(ALLOC_REGS), std::end(ALLOC_REGS) } };
+        const std::vector<std::optional<Reg>> regs{ allocator.allocate(usedIntervals) };
+
+        mRegs.assign(fn.vregCount, std::nullopt);
+        mSlots.assign(fn.vregCount, 0);
+        std::vector<Vreg> spilled{};
+        std::vector<LiveInterval> spilledIntervals{};
+        for (size_t i{ 0 }; i < used.size(); ++i) {
+            mRegs[used[i]] = regs[i];
+            if (!regs[i]) {
+                spilled.push_back(used[i]);
+                spilledIntervals.push_back(usedIntervals[i]);
+            }
+        }
 
-    void genScope(const NodeScope *const scope) {
-        beginScope();
-        comment("scope");
-        for (const NodeStmt *const stmt : scope->stmts) {
-            genStmt(stmt);
+        FrameLayout frame{};
+        const std::vector<size_t> slots{ frame.assign(spilledIntervals) };
+        for (size_t i{ 0 }; i < spilled.size(); ++i) {
+            mSlots[spilled[i]] = slots[i];
+        }
+        mSlotCount = frame.slotCount();
+        for (const Reg reg : CALLEE_SAVED) {
+            if (std::find(mRegs.cbegin(), mRegs.cend(), reg) != mRegs.cend()) {
+                mUsedCalleeSaved.push_back(reg);
+            }
         }
-        endScope();
     }
 
-    void genBranchIf(const NodeBranchIf *const ifBranch, const std::string &endLabel) {
-        comment("if");
-        genConditionAndScope(ifBranch->expr, ifBranch->scope, endLabel);
+    // Register, stack slot or immediate of an IR operand
+    Operand location(const IrOperand &operand) const {
+        if (operand.isImm()) {
+            return Operand::i(static_cast<int64_t>(operand.value));
+        }
+        return location(operand.vreg());
     }
 
-    void genBranchElif(const NodeBranchElif *const elifBranch, const std::string &endLabel) {
-        comment("elif");
-        genConditionAndScope(elifBranch->expr, elifBranch->scope, endLabel);
+    Operand location(const Vreg vreg) const {
+        if (mRegs[vreg]) {
+            return Operand::r(*mRegs[vreg]);
+        }
+        return Operand::mem(Reg::RBP, -static_cast<int64_t>(EIGHT_BYTES * (mSlots[vreg] + 1)));
     }
 
-    void genBranchElse(const NodeBranchElse *const elseBranch) {
-        comment("else");
-        genScope(elseBranch->scope);
+    // The counters lie in ascending order right below the stack slots
+    Operand counter(const size_t index) const {
+        return Operand::mem(Reg::RBP, -static_cast<int64_t>(EIGHT_BYTES * (mSlotCount + mCounterCount - index)));
     }
 
-    void genStmt(const NodeStmt *const stmt) {
-        std::visit(Visitor{
+    // `next` is the block laid out right after this one, reached by falling through
+    void genBlock(const IrBlock &block, const std::vector<Tile> &tiles, const size_t next) {
+        for (const size_t index : block.counters) {
+            instruction(Op::ADD, counter(index), Operand::i(1));
+        }
 
-            [this](const NodeStmtExit *const exitStmt) {
-                comment("exit");
-                genExpr(exitStmt->expr);
-                instruction("mov", "rax", 60);
-                pop("rdi");
-                syscall();
-            },
+        const IrInstr *compare{};
+        for (size_t i{ 0 }; i < block.instrs.size(); ++i) {
+            switch (tiles[i]) {
+            case Tile::PLAIN:
+                markLine(block.instrs[i].line);
+                genInstr(block.instrs[i]);
+                break;
+            case Tile::COVERED:
+                break;
+            case Tile::SCALED_ADD:
+                markLine(block.instrs[i].line);
+                genScaledAdd(block.instrs[i - 1], block.instrs[i]);
+                break;
+            case Tile::COMPARE:
+                compare = &block.instrs[i];
+                break;
+            }
+        }
 
-            [this](const NodeStmtLet *const letStmt) {
-                if (mVars.contains(letStmt->identifier.value.value())) {
-                    error("Identifier already used: " + letStmt->identifier.value.value());
-                }
-                comment("let");
-                mVars[letStmt->identifier.value.value()] = { .stackLoc = mStackLoc };
-                mVarOrder.push(letStmt->identifier.value.value());
-                genExpr(letStmt->expr);
-            },
-
-            [this](const NodeStmtAssign *const assignStmt) {
-                auto it = mVars.find(assignStmt->identifier.value.value());
-                if (it == mVars.cend()) {
-                    error("Undeclared identifier: " + assignStmt->identifier.value.value());
-                }
+        const IrTerm &term{ block.term };
+        switch (term.kind) {
+        case IrTerm::Kind::JMP:
+            jump(term.target, next);
+            break;
 
-                comment("assign");
-                genExpr(assignStmt->expr);
-                pop("rax");
-
-                instruction(
-                    "mov",
-                    "QWORD [rsp + " + std::to_string(EIGHT_BYTES*(mStackLoc-it->second.stackLoc-1)) + "]",
-                    "rax"
-                );
-            },
-
-            [this](const NodeStmtIf *const ifStmt) {
-                const std::string endLabel{ createLabel() };
-                genBranchIf(ifStmt->ifBranch, endLabel);
-                for (const NodeBranchElif *const elifBranch : ifStmt->elifBranches) {
-                    genBranchElif(elifBranch, endLabel);
-                }
-                if (ifStmt->elseBranch) {
-                    genBranchElse(ifStmt->elseBranch);
-                }
-                insertLabel(endLabel);
-            },
+        case IrTerm::Kind::BRANCH: {
+            if (term.value.isImm()) {
+                jump(term.value.value ? term.target : term.elseTarget, next);
+                break;
+            }
+            markLine(term.line);
+            if (compare) {
+                genCompare(location(compare->a), location(compare->b));
+            } else {
+                genTest(location(term.value));
+            }
+            if (term.elseTarget == next) {
+                instruction(Op::JNZ, Operand::lbl(term.target));
+                break;
+            }
+            instruction(Op::JZ, Operand::lbl(term.elseTarget));
+            jump(term.target, next);
+            break;
+        }
 
-            [this](const NodeScope *const scope) {
-                genScope(scope);
-            },
+        case IrTerm::Kind::EXIT:
+            markLine(term.line);
+            genExit(location(term.value));
+            break;
+        }
+    }
 
-        }, stmt->stmt);
+    // Starts the code of another source line; compiler-made code stays with the line before
+    void markLine(const int line) {
+        if (line != 0 && line != mLine) {
+            instruction(Op::LINE, Operand::i(line));
+            mLine = line;
+        }
     }
 
-    [[nodiscard]] std::string genProg(const NodeProg *const prog) {
-        mOutput << "global _start\n";
-        mOutput << "_start:\n";
+    void genInstr(const IrInstr &instr) {
+        const Operand dst{ location(instr.dst) };
+        const Operand a{ location(instr.a) };
+        switch (instr.op) {
+        case IrOp::COPY:
+            move(dst, a);
+            return;
+        case IrOp::ADD:
+            genAdd(dst, a, location(instr.b));
+            return;
+        case IrOp::SUB:
+            genArith(Op::SUB, dst, a, location(instr.b));
+            return;
+        case IrOp::MUL:
+            genMul(dst, a, location(instr.b));
+            return;
+        case IrOp::DIV:
+            genDiv(dst, a, location(instr.b));
+            return;
+        case IrOp::MULHU:
+            genMulHigh(dst, a, location(instr.b));
+            return;
+        case IrOp::SHL:
+            genArith(Op::SHL, dst, a, location(instr.b));
+            return;
+        case IrOp::SHR:
+            genArith(Op::SHR, dst, a, location(instr.b));
+            return;
+        }
+    }
 
-        for (const NodeStmt *const stmt : prog->stmts) {
-            genStmt(stmt);
+    // `dst = a op b` in two-address form, through the scratch register when `dst` can't
+    // be the working register
+    void genArith(const Op op, const Operand &dst, Operand a, Operand b) {
+        if ((op == Op::ADD || op == Op::IMUL) && b == dst) { // commutative
+            std::swap(a, b);
         }
+        const bool inPlace{ dst.kind == Operand::Kind::REG && !(b == dst) };
+        const Operand work{ inPlace ? dst : Operand::r(SCRATCH) };
 
-        // Exit with zero if no `exit` statement
-        instruction("mov", "rax", 60);
-        instruction("mov", "rdi", 0);
-        syscall();
+        move(work, a);
+        if (b.kind == Operand::Kind::IMM && (op == Op::IMUL || !fitsInt32(b))) {
+            move(Operand::r(Reg::RAX), b);
+            b = Operand::r(Reg::RAX);
+        }
+        instruction(op, work, b);
+        move(dst, work);
+    }
 
-        return mOutput.str();
+    // `lea` when the sum goes to a register other than the operands, saving the copy
+    void genAdd(const Operand &dst, Operand a, Operand b) {
+        if (a.kind == Operand::Kind::IMM) {
+            std::swap(a, b);
+        }
+        const bool leaFits{
+            dst.kind == Operand::Kind::REG && a.kind == Operand::Kind::REG && !(a == dst) && !(b == dst) &&
+            (b.kind == Operand::Kind::REG || (b.kind == Operand::Kind::IMM && fitsInt32(b)))
+        };
+        if (!leaFits) {
+            genArith(Op::ADD, dst, a, b);
+            return;
+        }
+        if (b.kind == Operand::Kind::IMM) {
+            instruction(Op::LEA, dst, Operand::mem(a.reg, b.imm));
+        } else {
+            instruction(Op::LEA, dst, Operand::mem(a.reg, b.reg, 1));
+        }
     }
 
-private:
-    // Helper type for the visitor
-    template<typename... Ts>
-    struct Visitor : Ts... {
-        using Ts::operator()...;
-    };
+    // Three-operand `imul` by a 32-bit immediate into a register
+    void genMul(const Operand &dst, Operand a, Operand b) {
+        if (a.kind == Operand::Kind::IMM) {
+            std::swap(a, b);
+        }
+        if (dst.kind != Operand::Kind::REG || a.kind == Operand::Kind::IMM || b.kind != Operand::Kind::IMM || !fitsInt32(b)) {
+            genArith(Op::IMUL, dst, a, b);
+            return;
+        }
+        mInstrs.push_back({ .op = Op::IMUL, .dst = dst, .src = a, .src2 = b });
+    }
 
-    struct Var {
-        size_t stackLoc{};
-        // TODO Type type;
-    };
+    // `dst = base + (index << k)` as one `lea`, with the covered `shl` giving the index
+    void genScaledAdd(const IrInstr &shl, const IrInstr &add) {
+        const IrOperand &baseOperand{ add.a == IrOperand::v(shl.dst) ? add.b : add.a };
+        Operand base{ location(baseOperand) };
+        Operand index{ location(shl.a) };
+        if (base.kind != Operand::Kind::REG) {
+            move(Operand::r(Reg::RAX), base);
+            base = Operand::r(Reg::RAX);
+        }
+        if (index.kind != Operand::Kind::REG) {
+            move(Operand::r(SCRATCH), index);
+            index = Operand::r(SCRATCH);
+        }
 
-    void comment(const std::string &comm) {
-        mOutput << "    ; " << comm << "\n";
+        const Operand dst{ location(add.dst) };
+        const Operand work{ dst.kind == Operand::Kind::REG ? dst : Operand::r(Reg::RAX) };
+        instruction(Op::LEA, work, Operand::mem(base.reg, index.reg, static_cast<uint8_t>(1u << shl.b.value)));
+        move(dst, work);
     }
 
-    std::string createLabel() {
-        return "label" + std::to_string(mLabelCount++);
+    // Sets the zero flag when `a == b`, as `a - b` would
+    void genCompare(Operand a, Operand b) {
+        if (a.kind == Operand::Kind::IMM) {
+            std::swap(a, b);
+        }
+        if (a.kind == Operand::Kind::IMM || (a.kind == Operand::Kind::MEM && b.kind == Operand::Kind::MEM)) {
+            move(Operand::r(SCRATCH), a);
+            a = Operand::r(SCRATCH);
+        }
+        if (!fitsInt32(b)) {
+            move(Operand::r(Reg::RAX), b);
+            b = Operand::r(Reg::RAX);
+        }
+        instruction(Op::CMP, a, b);
     }
 
-    void insertLabel(const std::string &label) {
-        mOutput << label << ":\n";
+    void genTest(Operand cond) {
+        if (cond.kind == Operand::Kind::MEM) {
+            move(Operand::r(SCRATCH), cond);
+            cond = Operand::r(SCRATCH);
+        }
+        if (!flagsHold(cond)) {
+            instruction(Op::TEST, cond, cond);
+        }
     }
 
-    void genConditionAndScope(
-        const NodeExpr *const condExpr,
-        const NodeScope *const scope,
-        const std::string &endLabel
-    ) {
-        // condition
-        genExpr(condExpr);
-        pop("rax");
-        instruction("test", "rax", "rax");
+    void genDiv(const Operand &dst, const Operand &a, Operand b) {
+        move(Operand::r(Reg::RAX), a);
+        if (b.kind == Operand::Kind::IMM) {
+            move(Operand::r(SCRATCH), b);
+            b = Operand::r(SCRATCH);
+        }
+        instruction(Op::XOR, Operand::r(Reg::RDX), Operand::r(Reg::RDX)); // div takes rdx:rax
+        instruction(Op::DIV, b);
+        move(dst, Operand::r(Reg::RAX));
+    }
 
-        // false
-        const std::string falseLabel{ createLabel() };
-        instruction("jz", falseLabel);
+    // `mul` leaves the high half of rax * b in rdx
+    void genMulHigh(const Operand &dst, const Operand &a, Operand b) {
+        move(Operand::r(Reg::RAX), a);
+        if (b.kind == Operand::Kind::IMM) {
+            move(Operand::r(SCRATCH), b);
+            b = Operand::r(SCRATCH);
+        }
+        instruction(Op::MUL, b);
+        move(dst, Operand::r(Reg::RDX));
+    }
 
-        // true
-        genScope(scope);
+    void jump(const size_t target, const size_t next) {
+        if (target != next) {
+            instruction(Op::JMP, Operand::lbl(target));
+        }
+    }
 
-        // end
-        instruction("jmp", endLabel);
+    // Whether the zero flag already tells if `reg` is zero: the last instruction, line markers
+    // aside, computed it with an `add`, `sub` or `xor`
+    bool flagsHold(const Operand &reg) const {
+        auto last{ mInstrs.crbegin() };
+        while (last != mInstrs.crend() && last->op == Op::LINE) {
+            ++last;
+        }
+        if (last == mInstrs.crend()) {
+            return false;
+        }
+        return (last->op == Op::ADD || last->op == Op::SUB || last->op == Op::XOR) && last->dst == reg;
+    }
 
-        insertLabel(falseLabel);
+    void move(const Operand &dst, const Operand &src) {
+        if (dst == src) {
+            return;
+        }
+        if (dst.kind == Operand::Kind::MEM && (src.kind == Operand::Kind::MEM || !fitsInt32(src))) {
+            instruction(Op::MOV, Operand::r(SCRATCH), src);
+            instruction(Op::MOV, dst, Operand::r(SCRATCH));
+            return;
+        }
+        instruction(Op::MOV, dst, src);
     }
 
-    void beginScope() {
-        mScopes.push(mVars.size());
+    void insertLabel(const size_t label) {
+        instruction(Op::LABEL, Operand::lbl(label));
     }
 
-    void endScope() {
-        const size_t popCount{ mVars.size() - mScopes.top() };
-        instruction("add", "rsp", EIGHT_BYTES * popCount);
-        mStackLoc -= popCount;
+    // Saves the callee-saved registers the generated code clobbers, makes room for the stack
+    // slots and clears the profile counters
+    void genPrologue() {
+        if (mExitMode == ExitMode::RETURN) {
+            for (const Reg reg : mUsedCalleeSaved) {
+                instruction(Op::PUSH, Operand::r(reg));
+            }
+            instruction(Op::PUSH, Operand::r(Reg::RBP));
+        }
+        const size_t frameSlots{ mSlotCount + mCounterCount };
+        if (mExitMode == ExitMode::RETURN || frameSlots > 0) {
+            instruction(Op::MOV, Operand::r(Reg::RBP), Operand::r(Reg::RSP));
+        }
+        if (frameSlots > 0) {
+            instruction(Op::SUB, Operand::r(Reg::RSP), Operand::i(static_cast<int64_t>(EIGHT_BYTES * frameSlots)));
+        }
+        for (size_t i{ 0 }; i < mCounterCount; ++i) {
+            instruction(Op::MOV, counter(i), Operand::i(0));
+        }
+    }
 
-        for (size_t i{ 0 }; i < popCount; ++i) {
-            mVars.erase(mVarOrder.top());
-            mVarOrder.pop();
+    // Writes the counters to the profile file and exits with the value on top of the stack.
+    // The path goes on the stack too, as the code has no data of its own.
+    void genDump() {
+        insertLabel(mDumpLabel);
+        std::string path{ mProfilePath };
+        path.resize((path.size() / EIGHT_BYTES + 1) * EIGHT_BYTES, '\0'); // at least one terminating zero
+        for (size_t offset{ path.size() }; offset > 0; offset -= EIGHT_BYTES) {
+            int64_t chunk{};
+            std::memcpy(&chunk, path.data() + offset - EIGHT_BYTES, EIGHT_BYTES);
+            instruction(Op::MOV, Operand::r(Reg::RAX), Operand::i(chunk));
+            instruction(Op::PUSH, Operand::r(Reg::RAX));
         }
 
-        mScopes.pop();
-    }
+        instruction(Op::MOV, Operand::r(Reg::RAX), Operand::i(SYS_OPEN));
+        instruction(Op::MOV, Operand::r(Reg::RDI), Operand::r(Reg::RSP));
+        instruction(Op::MOV, Operand::r(Reg::RSI), Operand::i(PROFILE_OPEN_FLAGS));
+        instruction(Op::MOV, Operand::r(Reg::RDX), Operand::i(PROFILE_MODE));
+        syscall();
+        instruction(Op::MOV, Operand::r(Reg::RDI), Operand::r(Reg::RAX)); // a failed open fails the write too
+        instruction(Op::MOV, Operand::r(Reg::RAX), Operand::i(SYS_WRITE));
+        instruction(Op::LEA, Operand::r(Reg::RSI), counter(0));
+        instruction(Op::MOV, Operand::r(Reg::RDX), Operand::i(static_cast<int64_t>(EIGHT_BYTES * mCounterCount)));
+        syscall();
+        instruction(Op::MOV, Operand::r(Reg::RAX), Operand::i(SYS_CLOSE));
+        syscall();
 
-    void push(const std::string &reg) {
-        instruction("push", reg);
-        ++mStackLoc;
+        instruction(Op::ADD, Operand::r(Reg::RSP), Operand::i(static_cast<int64_t>(path.size())));
+        if (mExitMode == ExitMode::RETURN) {
+            instruction(Op::POP, Operand::r(Reg::RAX)); // falls through into the epilogue
+            return;
+        }
+        instruction(Op::POP, Operand::r(Reg::RDI));
+        instruction(Op::MOV, Operand::r(Reg::RAX), Operand::i(SYS_EXIT));
+        syscall();
     }
 
-    void pop(const std::string &reg) {
-        instruction("pop", reg);
-        --mStackLoc;
+    void genEpilogue() {
+        insertLabel(mEpilogueLabel);
+        instruction(Op::MOV, Operand::r(Reg::RSP), Operand::r(Reg::RBP));
+        instruction(Op::POP, Operand::r(Reg::RBP));
+        for (auto it{ mUsedCalleeSaved.crbegin() }; it != mUsedCalleeSaved.crend(); ++it) {
+            instruction(Op::POP, Operand::r(*it));
+        }
+        instruction(Op::RET);
     }
 
-    void syscall() {
-        instruction("syscall");
-    }
+    void genExit(const Operand &value) {
+        if (mCounterCount > 0) {
+            move(Operand::r(Reg::RAX), value);
+            instruction(Op::PUSH, Operand::r(Reg::RAX));
+            instruction(Op::JMP, Operand::lbl(mDumpLabel));
+            return;
+        }
+        if (mExitMode == ExitMode::RETURN) {
+            instruction(Op::MOV, Operand::r(Reg::RAX), value);
+            instruction(Op::JMP, Operand::lbl(mEpilogueLabel));
+            return;
+        }
 
-    void instruction(const std::string &instruction) {
-        mOutput << "    " << instruction << "\n";
+        instruction(Op::MOV, Operand::r(Reg::RDI), value);
+        instruction(Op::MOV, Operand::r(Reg::RAX), Operand::i(SYS_EXIT));
+        syscall();
     }
 
-    template <typename T>
-    void instruction(const std::string &instruction, const T &arg) {
-        mOutput << "    " << instruction << " " << arg << "\n";
+    void syscall() {
+        instruction(Op::SYSCALL);
     }
 
-    template <typename T1, typename T2>
-    void instruction(const std::string &instruction, const T1 &arg1, const T2 &arg2) {
-        mOutput << "    " << instruction << " " << arg1 << ", " << arg2 << "\n";
+    void instruction(const Op op, const Operand &dst = {}, const Operand &src = {}) {
+        mInstrs.push_back({ .op = op, .dst = dst, .src = src });
     }
 
-    std::stringstream mOutput{};
-    size_t mStackLoc{};
-    size_t mLabelCount{};
-    std::unordered_map<std::string, Var> mVars{};
-    std::stack<std::string, std::vector<std::string>> mVarOrder{};
-    std::stack<size_t, std::vector<size_t>> mScopes{};
+    InstrList mInstrs{};
+    std::vector<std::vector<Tile>> mTiles{};
+    std::vector<std::optional<Reg>> mRegs{};
+    std::vector<size_t> mSlots{};
+    size_t mSlotCount{};
+    std::vector<Reg> mUsedCalleeSaved{};
+    size_t mCounterCount{}; // profile counters of an instrumented function
+    ExitMode mExitMode{ ExitMode::SYSCALL };
+    std::string mProfilePath{};
+    size_t mEpilogueLabel{};
+    size_t mDumpLabel{};
+    int mLine{}; // of the last line marker
 };
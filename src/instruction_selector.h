@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint> // uint8_t
+#include <cstdlib> // size_t
+#include <limits>
+#include <vector>
+
+#include "ir.h"
+
+// How an instruction is covered when emitting x86
+enum class Tile : uint8_t {
+    PLAIN, // on its own
+    COVERED, // folded into the tile of the next instruction
+    SCALED_ADD, // `lea dst, [base + index * 2^k]` over the covered `shl` and this `add`
+    COMPARE, // `cmp a, b` setting the flags for the branch instead of computing `a - b`
+};
+
+// Chooses the cheapest cover of each block by tree patterns. An instruction whose result
+// has one use, right after it, forms a tree with that use, and a pattern may cover both; a
+// `sub` whose only use is the branch ending its block becomes a comparison. Dynamic
+// programming over the block picks the cover with the lowest cost. Needs the IR out of SSA
+// form, as the generator expects it.
+class InstructionSelector {
+public:
+    InstructionSelector(const InstructionSelector &) = delete;
+    InstructionSelector &operator=(const InstructionSelector &) = delete;
+
+    InstructionSelector() = default;
+
+    // Tile of each instruction of each block
+    [[nodiscard]] std::vector<std::vector<Tile>> select(const IrFunction &fn) {
+        countUses(fn);
+
+        std::vector<std::vector<Tile>> tiles{};
+        for (const IrBlock &block : fn.blocks) {
+            tiles.push_back(selectBlock(block));
+        }
+        return tiles;
+    }
+
+private:
+    // Rough latencies of the x86 each tile emits
+    static constexpr size_t COST_COPY{ 1 };
+    static constexpr size_t COST_ALU{ 1 };
+    static constexpr size_t COST_MUL{ 3 };
+    static constexpr size_t COST_MULHU{ 4 };
+    static constexpr size_t COST_DIV{ 40 };
+    static constexpr size_t COST_LEA{ 1 };
+    static constexpr size_t COST_TEST{ 1 };
+    static constexpr size_t COST_CMP{ 1 };
+    static constexpr size_t MAX_LEA_SHIFT{ 3 }; // scales up to 8
+
+    static size_t plainCost(const IrInstr &instr) {
+        switch (instr.op) {
+        case IrOp::COPY:
+            return COST_COPY;
+        case IrOp::ADD:
+        case IrOp::SUB:
+        case IrOp::SHL:
+        case IrOp::SHR:
+            return COST_ALU;
+        case IrOp::MUL:
+            return COST_MUL;
+        case IrOp::MULHU:
+            return COST_MULHU;
+        case IrOp::DIV:
+            return COST_DIV;
+        }
+        return 0;
+    }
+
+    void countUses(const IrFunction &fn) {
+        mUses.assign(fn.vregCount, 0);
+        mDefs.assign(fn.vregCount, 0);
+        const auto use{ [this](const IrOperand &operand) {
+            if (operand.isVreg()) {
+                ++mUses[operand.vreg()];
+            }
+        } };
+        for (const IrBlock &block : fn.blocks) {
+            for (const IrPhi &phi : block.phis) {
+                ++mDefs[phi.dst];
+                for (const IrOperand &arg : phi.args) {
+                    use(arg);
+                }
+            }
+            for (const IrInstr &instr : block.instrs) {
+                ++mDefs[instr.dst];
+                use(instr.a);
+                use(instr.b);
+            }
+            use(block.term.value);
+        }
+    }
+
+    // Whether `operand` is the single-use, single-definition result of `def`
+    bool feedsOnly(const IrInstr &def, const IrOperand &operand) const {
+        return operand == IrOperand::v(def.dst) && mUses[def.dst] == 1 && mDefs[def.dst] == 1;
+    }
+
+    // `add` of a vreg and a covered `shl` of another vreg by 1 to 3
+    bool matchesScaledAdd(const IrInstr &shl, const IrInstr &add) const {
+        if (shl.op != IrOp::SHL || add.op != IrOp::ADD || !shl.a.isVreg() || shl.a == IrOperand::v(shl.dst)) {
+            return false;
+        }
+        if (!shl.b.isImm() || shl.b.value == 0 || shl.b.value > MAX_LEA_SHIFT) {
+            return false;
+        }
+        const IrOperand &base{ feedsOnly(shl, add.a) ? add.b : add.a };
+        return (feedsOnly(shl, add.a) || feedsOnly(shl, add.b)) && base.isVreg() && base != IrOperand::v(shl.dst);
+    }
+
+    std::vector<Tile> selectBlock(const IrBlock &block) {
+        const std::vector<IrInstr> &instrs{ block.instrs };
+        const size_t count{ instrs.size() };
+
+        // cost[i]: cheapest cover of the first i instructions, with choice[i] the tile of the last
+        constexpr size_t INF{ std::numeric_limits<size_t>::max() };
+        std::vector<size_t> cost(count + 1, INF);
+        std::vector<Tile> choice(count + 1, Tile::PLAIN);
+        cost[0] = 0;
+        for (size_t i{ 1 }; i <= count; ++i) {
+            cost[i] = cost[i - 1] + plainCost(instrs[i - 1]);
+            if (i >= 2 && matchesScaledAdd(instrs[i - 2], instrs[i - 1]) && cost[i - 2] + COST_LEA < cost[i]) {
+                cost[i] = cost[i - 2] + COST_LEA;
+                choice[i] = Tile::SCALED_ADD;
+            }
+        }
+
+        // the branch tests its value, unless a comparison can stand in for the last `sub`
+        size_t end{ count };
+        Tile last{ count > 0 ? choice[count] : Tile::PLAIN };
+        const IrTerm &term{ block.term };
+        if (count > 0 && term.kind == IrTerm::Kind::BRANCH) {
+            const IrInstr &sub{ instrs.back() };
+            const bool comparable{ sub.op == IrOp::SUB && feedsOnly(sub, term.value) && !(sub.a.isImm() && sub.b.isImm()) };
+            if (comparable && cost[count - 1] + COST_CMP < cost[count] + COST_TEST) {
+                last = Tile::COMPARE;
+            }
+        }
+
+        std::vector<Tile> tiles(count, Tile::PLAIN);
+        while (end > 0) {
+            const Tile tile{ end == count ? last : choice[end] };
+            tiles[end - 1] = tile;
+            if (tile == Tile::SCALED_ADD) {
+                tiles[end - 2] = Tile::COVERED;
+                end -= 2;
+            } else {
+                end -= 1;
+            }
+        }
+        return tiles;
+    }
+
+    std::vector<size_t> mUses{};
+    std::vector<size_t> mDefs{};
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <csignal> // std::raise, SIGFPE
+#include <cstdint> // int64_t, uint8_t, uint32_t, uint64_t
+#include <cstring> // std::memcpy
+#include <vector>
+
+#include "bytecode.h"
+
+// Runs bytecode with threaded dispatch: every handler jumps straight to the next one
+// through a label table (GCC/Clang computed goto), falling back to a switch loop elsewhere.
+// Arithmetic is unsigned 64-bit like the native code, and division by zero raises SIGFPE.
+class Interpreter {
+public:
+    Interpreter() = delete;
+    Interpreter(const Interpreter &) = delete;
+    Interpreter &operator=(const Interpreter &) = delete;
+
+    explicit Interpreter(const Bytecode &bytecode) :
+        mBytecode{ bytecode },
+        mSlots(bytecode.slotCount),
+        mStack(bytecode.stackDepth + 1) {}
+
+    [[nodiscard]] int64_t run() {
+        const uint8_t *const code{ mBytecode.code.data() };
+        const uint8_t *ip{ code };
+        uint64_t *const slots{ mSlots.data() };
+        uint64_t *sp{ mStack.data() }; // points past the top of the stack
+
+#if defined(__GNUC__)
+        static const void *const DISPATCH_TABLE[]{
+            &&opPush, &&opLoad, &&opStore, &&opAdd, &&opSub, &&opMul, &&opDiv, &&opJz, &&opJmp, &&opExit,
+        };
+#define DISPATCH() goto *DISPATCH_TABLE[*ip++]
+#define CASE(name, label) label
+        DISPATCH();
+#else
+#define DISPATCH() break
+#define CASE(name, label) case OpCode::name
+        while (true) {
+        switch (static_cast<OpCode>(*ip++)) {
+#endif
+
+        CASE(PUSH, opPush): {
+            *sp++ = static_cast<uint64_t>(read<int64_t>(ip));
+            DISPATCH();
+        }
+
+        CASE(LOAD, opLoad): {
+            *sp++ = slots[read<uint32_t>(ip)];
+            DISPATCH();
+        }
+
+        CASE(STORE, opStore): {
+            slots[read<uint32_t>(ip)] = *--sp;
+            DISPATCH();
+        }
+
+        CASE(ADD, opAdd): {
+            --sp;
+            sp[-1] += *sp;
+            DISPATCH();
+        }
+
+        CASE(SUB, opSub): {
+            --sp;
+            sp[-1] -= *sp;
+            DISPATCH();
+        }
+
+        CASE(MUL, opMul): {
+            --sp;
+            sp[-1] *= *sp;
+            DISPATCH();
+        }
+
+        CASE(DIV, opDiv): {
+            --sp;
+            if (*sp == 0) {
+                std::raise(SIGFPE);
+            }
+            sp[-1] /= *sp;
+            DISPATCH();
+        }
+
+        CASE(JZ, opJz): {
+            const uint32_t target{ read<uint32_t>(ip) };
+            if (*--sp == 0) {
+                ip = code + target;
+            }
+            DISPATCH();
+        }
+
+        CASE(JMP, opJmp): {
+            ip = code + read<uint32_t>(ip);
+            DISPATCH();
+        }
+
+        CASE(EXIT, opExit): {
+            return static_cast<int64_t>(*--sp);
+        }
+
+#if !defined(__GNUC__)
+        }
+        }
+#endif
+#undef DISPATCH
+#undef CASE
+    }
+
+private:
+    template <typename T>
+    static T read(const uint8_t *&ip) {
+        T value{};
+        std::memcpy(&value, ip, sizeof(T));
+        ip += sizeof(T);
+        return value;
+    }
+
+    const Bytecode &mBytecode;
+    std::vector<uint64_t> mSlots{};
+    std::vector<uint64_t> mStack{};
+};
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <cstdint> // uint8_t, uint32_t, uint64_t
+#include <cstdlib> // size_t
+#include <sstream>
+#include <string>
+#include <utility> // std::move, std::pair
+#include <vector>
+
+// Mid-level three-address IR: a single function of basic blocks over virtual registers.
+// Values are unsigned 64-bit; `div` by zero traps like the native code.
+
+using Vreg = uint32_t;
+
+struct IrOperand {
+    enum class Kind : uint8_t {
+        NONE,
+        VREG,
+        IMM,
+    };
+
+    Kind kind{ Kind::NONE };
+    uint64_t value{}; // register number or immediate
+
+    static IrOperand v(const Vreg vreg) { return { .kind = Kind::VREG, .value = vreg }; }
+    static IrOperand i(const uint64_t imm) { return { .kind = Kind::IMM, .value = imm }; }
+
+    [[nodiscard]] bool isVreg() const { return kind == Kind::VREG; }
+    [[nodiscard]] bool isImm() const { return kind == Kind::IMM; }
+    [[nodiscard]] Vreg vreg() const { return static_cast<Vreg>(value); }
+
+    bool operator==(const IrOperand &) const = default;
+};
+
+enum class IrOp : uint8_t {
+    COPY, // dst = a
+    ADD, // dst = a + b
+    SUB,
+    MUL,
+    DIV,
+    MULHU, // high 64 bits of the 128-bit product
+    SHL, // shifts by a constant `b`
+    SHR, // logical
+};
+
+struct IrInstr {
+    IrOp op{};
+    Vreg dst{};
+    IrOperand a{};
+    IrOperand b{};
+    int line{}; // source line, or 0 for code the compiler added
+};
+
+// Only present in SSA form; `args[i]` comes from `preds[i]` of the block
+struct IrPhi {
+    Vreg dst{};
+    std::vector<IrOperand> args{};
+    std::vector<int> lines{}; // of the definition of each argument, for its copy out of SSA form
+};
+
+struct IrTerm {
+    enum class Kind : uint8_t {
+        JMP, // to `target`
+        BRANCH, // to `target` if `value` is nonzero, else to `elseTarget`
+        EXIT, // leave the program with `value`
+    };
+
+    Kind kind{ Kind::EXIT };
+    IrOperand value{};
+    size_t target{};
+    size_t elseTarget{};
+    int line{}; // source line of the condition or `exit`
+};
+
+struct IrBlock {
+    std::vector<IrPhi> phis{};
+    std::vector<IrInstr> instrs{};
+    IrTerm term{};
+    std::vector<size_t> preds{};
+    std::vector<size_t> counters{}; // profile counters bumped on entry, in an instrumented build
+    uint64_t count{}; // times the block ran in the profile, if there is one
+};
+
+struct IrFunction {
+    std::vector<IrBlock> blocks{}; // `blocks[0]` is the entry
+    Vreg vregCount{};
+    bool ssa{};
+    size_t counterCount{}; // profile counters of an instrumented build
+    bool profiled{}; // block counts come from a profile
+
+    Vreg newVreg() {
+        return vregCount++;
+    }
+};
+
+inline std::vector<size_t> successors(const IrBlock &block) {
+    switch (block.term.kind) {
+    case IrTerm::Kind::JMP:
+        return { block.term.target };
+    case IrTerm::Kind::BRANCH:
+        return { block.term.target, block.term.elseTarget };
+    case IrTerm::Kind::EXIT:
+        return {};
+    }
+    return {};
+}
+
+inline void computePreds(IrFunction &fn) {
+    for (IrBlock &block : fn.blocks) {
+        block.preds.clear();
+    }
+    for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+        for (const size_t succ : successors(fn.blocks[b])) {
+            fn.blocks[succ].preds.push_back(b);
+        }
+    }
+}
+
+// Blocks reachable from the entry in reverse postorder
+inline std::vector<size_t> reversePostorder(const IrFunction &fn) {
+    std::vector<size_t> order{};
+    std::vector<bool> visited(fn.blocks.size());
+    std::vector<std::pair<size_t, size_t>> stack{ { 0, 0 } }; // block, next successor
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto &[block, next]{ stack.back() };
+        const std::vector<size_t> succs{ successors(fn.blocks[block]) };
+        if (next < succs.size()) {
+            const size_t succ{ succs[next++] };
+            if (!visited[succ]) {
+                visited[succ] = true;
+                stack.push_back({ succ, 0 });
+            }
+            continue;
+        }
+        order.push_back(block);
+        stack.pop_back();
+    }
+    return { order.rbegin(), order.rend() };
+}
+
+// Drops the blocks the entry can't reach and renumbers the rest in their original order
+inline void removeUnreachableBlocks(IrFunction &fn) {
+    std::vector<bool> reachable(fn.blocks.size());
+    for (const size_t block : reversePostorder(fn)) {
+        reachable[block] = true;
+    }
+
+    std::vector<size_t> newIndex(fn.blocks.size());
+    std::vector<IrBlock> blocks{};
+    for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+        if (reachable[b]) {
+            newIndex[b] = blocks.size();
+            blocks.push_back(std::move(fn.blocks[b]));
+        }
+    }
+    for (IrBlock &block : blocks) {
+        block.term.target = newIndex[block.term.target];
+        block.term.elseTarget = newIndex[block.term.elseTarget];
+    }
+
+    // phi arguments follow the surviving predecessors
+    std::vector<std::vector<size_t>> oldPreds{};
+    for (const IrBlock &block : blocks) {
+        oldPreds.push_back(block.preds);
+    }
+    fn.blocks = std::move(blocks);
+    computePreds(fn);
+    if (!fn.ssa) {
+        return;
+    }
+    for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+        IrBlock &block{ fn.blocks[b] };
+        for (IrPhi &phi : block.phis) {
+            std::vector<IrOperand> args{};
+            std::vector<int> lines{};
+            for (const size_t pred : block.preds) {
+                for (size_t i{ 0 }; i < oldPreds[b].size(); ++i) {
+                    if (reachable[oldPreds[b][i]] && newIndex[oldPreds[b][i]] == pred) {
+                        args.push_back(phi.args[i]);
+                        lines.push_back(phi.lines[i]);
+                        break;
+                    }
+                }
+            }
+            phi.args = std::move(args);
+            phi.lines = std::move(lines);
+        }
+    }
+}
+
+// Puts the blocks in the given order, which must start with the entry and list every block
+// once. Only for functions out of SSA form, as the predecessors are recomputed.
+inline void reorderBlocks(IrFunction &fn, const std::vector<size_t> &order) {
+    std::vector<size_t> newIndex(fn.blocks.size());
+    for (size_t i{ 0 }; i < order.size(); ++i) {
+        newIndex[order[i]] = i;
+    }
+
+    std::vector<IrBlock> blocks{};
+    blocks.reserve(order.size());
+    for (const size_t block : order) {
+        blocks.push_back(std::move(fn.blocks[block]));
+        blocks.back().term.target = newIndex[blocks.back().term.target];
+        blocks.back().term.elseTarget = newIndex[blocks.back().term.elseTarget];
+    }
+    fn.blocks = std::move(blocks);
+    computePreds(fn);
+}
+
+// Copies the instructions of `block` and its terminator's value for another block. The
+// temporaries the block defines and only uses after that, within itself, get fresh registers
+// in the copy, so each copy keeps single-definition temporaries the selector can tile. Only
+// for functions out of SSA form.
+inline std::vector<IrInstr> cloneInstrs(IrFunction &fn, const IrBlock &block, IrTerm &term) {
+    // uses outside the block, or before the block defines the register, keep it shared
+    std::vector<bool> shared(fn.vregCount);
+    std::vector<bool> defined(fn.vregCount);
+    const auto useIn{ [&shared, &defined](const IrOperand &operand, const bool inBlock) {
+        if (operand.isVreg() && (!inBlock || !defined[operand.vreg()])) {
+            shared[operand.vreg()] = true;
+        }
+    } };
+    for (const IrBlock &other : fn.blocks) {
+        const bool inBlock{ &other == &block };
+        for (const IrInstr &instr : other.instrs) {
+            useIn(instr.a, inBlock);
+            useIn(instr.b, inBlock);
+            if (inBlock) {
+                defined[instr.dst] = true;
+            } else {
+                shared[instr.dst] = true;
+            }
+        }
+        useIn(other.term.value, inBlock);
+    }
+
+    std::vector<IrInstr> instrs{ block.instrs };
+    std::vector<Vreg> renamed(fn.vregCount);
+    std::vector<bool> isRenamed(fn.vregCount);
+    const auto rename{ [&renamed, &isRenamed](IrOperand &operand) {
+        if (operand.isVreg() && isRenamed[operand.vreg()]) {
+            operand = IrOperand::v(renamed[operand.vreg()]);
+        }
+    } };
+    for (IrInstr &instr : instrs) {
+        rename(instr.a);
+        rename(instr.b);
+        if (!shared[instr.dst]) {
+            renamed[instr.dst] = fn.newVreg();
+            isRenamed[instr.dst] = true;
+            instr.dst = renamed[instr.dst];
+        }
+    }
+    rename(term.value);
+    return instrs;
+}
+
+inline std::string to_string(const IrOperand &operand) {
+    switch (operand.kind) {
+    case IrOperand::Kind::NONE:
+        return "_";
+    case IrOperand::Kind::VREG:
+        return "%" + std::to_string(operand.value);
+    case IrOperand::Kind::IMM:
+        return std::to_string(operand.value);
+    }
+    return {};
+}
+
+inline std::string to_string(const IrOp op) {
+    switch (op) {
+    case IrOp::COPY:
+        return "copy";
+    case IrOp::ADD:
+        return "add";
+    case IrOp::SUB:
+        return "sub";
+    case IrOp::MUL:
+        return "mul";
+    case IrOp::DIV:
+        return "div";
+    case IrOp::MULHU:
+        return "mulhu";
+    case IrOp::SHL:
+        return "shl";
+    case IrOp::SHR:
+        return "shr";
+    }
+    return {};
+}
+
+inline std::string to_string(const IrFunction &fn) {
+    std::stringstream out{};
+    for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+        const IrBlock &block{ fn.blocks[b] };
+        out << "bb" << b << ":";
+        if (!block.preds.empty()) {
+            out << " ; preds";
+            for (const size_t pred : block.preds) {
+                out << " bb" << pred;
+            }
+        }
+        if (fn.profiled) {
+            out << " ; count " << block.count;
+        }
+        out << "\n";
+
+        for (const size_t counter : block.counters) {
+            out << "    counter " << counter << "\n";
+        }
+
+        for (const IrPhi &phi : block.phis) {
+            out << "    %" << phi.dst << " = phi";
+            for (size_t i{ 0 }; i < phi.args.size(); ++i) {
+                out << (i ? ", " : " ") << "[bb" << block.preds[i] << " " << to_string(phi.args[i]) << "]";
+            }
+            out << "\n";
+        }
+
+        for (const IrInstr &instr : block.instrs) {
+            out << "    %" << instr.dst << " = " << to_string(instr.op) << " " << to_string(instr.a);
+            if (instr.op != IrOp::COPY) {
+                out << ", " << to_string(instr.b);
+            }
+            out << "\n";
+        }
+
+        const IrTerm &term{ block.term };
+        switch (term.kind) {
+        case IrTerm::Kind::JMP:
+            out << "    jmp bb" << term.target << "\n";
+            break;
+        case IrTerm::Kind::BRANCH:
+            out << "    br " << to_string(term.value) << ", bb" << term.target << ", bb" << term.elseTarget << "\n";
+            break;
+        case IrTerm::Kind::EXIT:
+            out << "    exit " << to_string(term.value) << "\n";
+            break;
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm> // std::max
+#include <cstdlib> // size_t
+#include <optional>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility> // std::move
+#include <vector>
+
+#include "error.h"
+#include "flat_ast.h"
+#include "ir.h"
+#include "parser.h"
+
+// Lowers the AST to IR, from its flat form. Every `let` variable gets its own virtual
+// register that assignments overwrite, and every operator a fresh temporary. Names are
+// resolved here, so undeclared and redeclared identifiers are reported here. Instructions and
+// terminators carry the line of the statement or condition they come from.
+class IrBuilder {
+public:
+    IrBuilder(const IrBuilder &) = delete;
+    IrBuilder &operator=(const IrBuilder &) = delete;
+
+    IrBuilder() = default;
+
+    [[nodiscard]] IrFunction build(const NodeProg *const prog) {
+        AstFlattener flattener{};
+        return build(flattener.flatten(prog));
+    }
+
+    [[nodiscard]] IrFunction build(const FlatAst &ast) {
+        mAst = &ast;
+        labelExprs();
+
+        mCurrent = newBlock();
+        const FlatNode &prog{ ast[ast.root()] };
+        for (NodeIndex i{ 0 }; i < prog.b; ++i) {
+            lowerStmt(ast.childrenOf(prog)[i]);
+        }
+
+        // Exit with zero if no `exit` statement
+        terminate({ .kind = IrTerm::Kind::EXIT, .value = IrOperand::i(0) });
+
+        removeUnreachableBlocks(mFn);
+        return std::move(mFn);
+    }
+
+private:
+    static IrOp irOp(const NodeKind kind) {
+        switch (kind) {
+        case NodeKind::ADD:
+            return IrOp::ADD;
+        case NodeKind::SUB:
+            return IrOp::SUB;
+        case NodeKind::MUL:
+            return IrOp::MUL;
+        case NodeKind::DIV:
+            return IrOp::DIV;
+        default:
+            break;
+        }
+
+        return {}; // unreachable
+    }
+
+    // Sethi-Ullman (Ershov) numbers counting temporaries; variables and literals need none.
+    // Children come first in the array, so one pass labels every expression.
+    void labelExprs() {
+        mRegNeeds.assign(mAst->nodes.size(), 0);
+        for (NodeIndex i{ 0 }; i < mAst->nodes.size(); ++i) {
+            const FlatNode &node{ (*mAst)[i] };
+            switch (node.kind) {
+            case NodeKind::PAREN:
+                mRegNeeds[i] = mRegNeeds[node.a];
+                break;
+            case NodeKind::ADD:
+            case NodeKind::SUB:
+            case NodeKind::MUL:
+            case NodeKind::DIV: {
+                const size_t lhsNeed{ mRegNeeds[node.a] };
+                const size_t rhsNeed{ mRegNeeds[node.b] };
+                mRegNeeds[i] = lhsNeed == rhsNeed ? lhsNeed + 1 : std::max(lhsNeed, rhsNeed);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    IrOperand lowerTerm(const FlatNode &term) {
+        switch (term.kind) {
+        case NodeKind::INT_LITERAL:
+            return IrOperand::i(mAst->literals[term.a]);
+        case NodeKind::IDENTIFIER: {
+            const std::string_view name{ mAst->names[term.a] };
+            const auto it{ mVars.find(name) };
+            if (it == mVars.cend()) {
+                error("Undeclared variable: " + std::string{ name });
+            }
+            return IrOperand::v(it->second);
+        }
+        case NodeKind::PAREN:
+            return lowerExpr(term.a, std::nullopt);
+        default:
+            break;
+        }
+
+        return {}; // unreachable
+    }
+
+    // The operand that needs more temporaries is lowered first, which keeps fewer of them live
+    IrOperand lowerBinExpr(const FlatNode &binExpr, const std::optional<Vreg> dst) {
+        IrOperand a{};
+        IrOperand b{};
+        if (mRegNeeds[binExpr.b] > mRegNeeds[binExpr.a]) {
+            b = lowerExpr(binExpr.b, std::nullopt);
+            a = lowerExpr(binExpr.a, std::nullopt);
+        } else {
+            a = lowerExpr(binExpr.a, std::nullopt);
+            b = lowerExpr(binExpr.b, std::nullopt);
+        }
+
+        const Vreg result{ dst ? *dst : mFn.newVreg() };
+        emit({ .op = irOp(binExpr.kind), .dst = result, .a = a, .b = b });
+        return IrOperand::v(result);
+    }
+
+    // Lowers the expression, into `dst` if given
+    IrOperand lowerExpr(const NodeIndex index, const std::optional<Vreg> dst) {
+        const FlatNode &expr{ (*mAst)[index] };
+        switch (expr.kind) {
+        case NodeKind::ADD:
+        case NodeKind::SUB:
+        case NodeKind::MUL:
+        case NodeKind::DIV:
+            return lowerBinExpr(expr, dst);
+        default:
+            break;
+        }
+
+        const IrOperand value{ lowerTerm(expr) };
+        if (!dst) {
+            return value;
+        }
+        emit({ .op = IrOp::COPY, .dst = *dst, .a = value });
+        return IrOperand::v(*dst);
+    }
+
+    void lowerScope(const NodeIndex index) {
+        const FlatNode &scope{ (*mAst)[index] };
+        mScopes.push(mVars.size());
+        for (NodeIndex i{ 0 }; i < scope.b; ++i) {
+            lowerStmt(mAst->childrenOf(scope)[i]);
+        }
+        const size_t popCount{ mVars.size() - mScopes.top() };
+        for (size_t i{ 0 }; i < popCount; ++i) {
+            mVars.erase(mVarOrder.top());
+            mVarOrder.pop();
+        }
+        mScopes.pop();
+    }
+
+    // Branches on the condition into a new block with the scope, which then jumps to the block
+    // recorded in `exits`; lowering carries on in the block taken when the condition is zero
+    void lowerConditionAndScope(const NodeIndex condExpr, const NodeIndex scope, std::vector<size_t> &exits) {
+        mLine = (*mAst)[condExpr].line;
+        const IrOperand cond{ lowerExpr(condExpr, std::nullopt) };
+        const size_t thenBlock{ newBlock() };
+        const size_t elseBlock{ newBlock() };
+        terminate({ .kind = IrTerm::Kind::BRANCH, .value = cond, .target = thenBlock, .elseTarget = elseBlock });
+
+        mCurrent = thenBlock;
+        lowerScope(scope);
+        exits.push_back(mCurrent);
+        terminate({ .kind = IrTerm::Kind::JMP });
+
+        mCurrent = elseBlock;
+    }
+
+    void lowerStmt(const NodeIndex index) {
+        const FlatNode &stmt{ (*mAst)[index] };
+        switch (stmt.kind) {
+
+        case NodeKind::EXIT: {
+            mLine = stmt.line;
+            const IrOperand value{ lowerExpr(stmt.a, std::nullopt) };
+            terminate({ .kind = IrTerm::Kind::EXIT, .value = value });
+            mCurrent = newBlock(); // unreachable, dropped at the end
+            break;
+        }
+
+        case NodeKind::LET: {
+            const std::string_view name{ mAst->names[stmt.a] };
+            if (mVars.contains(name)) {
+                error("Identifier already used: " + std::string{ name });
+            }
+            mLine = stmt.line;
+            const Vreg var{ mFn.newVreg() };
+            lowerExpr(stmt.b, var); // the initializer can't see the new variable
+            mVars[name] = var;
+            mVarOrder.push(name);
+            break;
+        }
+
+        case NodeKind::ASSIGN: {
+            const std::string_view name{ mAst->names[stmt.a] };
+            const auto it{ mVars.find(name) };
+            if (it == mVars.cend()) {
+                error("Undeclared identifier: " + std::string{ name });
+            }
+            mLine = stmt.line;
+            lowerExpr(stmt.b, it->second);
+            break;
+        }
+
+        case NodeKind::IF: {
+            const NodeIndex *const branches{ mAst->childrenOf(stmt) };
+            std::vector<size_t> exits{};
+            NodeIndex i{ 0 };
+            for (; i + 1 < stmt.b; i += 2) { // `if` and `elif` branches
+                lowerConditionAndScope(branches[i], branches[i + 1], exits);
+            }
+            if (i < stmt.b) {
+                lowerScope(branches[i]);
+            }
+            exits.push_back(mCurrent);
+            terminate({ .kind = IrTerm::Kind::JMP });
+
+            const size_t endBlock{ newBlock() };
+            for (const size_t exit : exits) {
+                mFn.blocks[exit].term.target = endBlock;
+            }
+            mCurrent = endBlock;
+            break;
+        }
+
+        // The header checks the condition; the body jumps back to it
+        case NodeKind::WHILE: {
+            const size_t headerBlock{ newBlock() };
+            terminate({ .kind = IrTerm::Kind::JMP, .target = headerBlock });
+
+            mCurrent = headerBlock;
+            mLine = stmt.line;
+            const IrOperand cond{ lowerExpr(stmt.a, std::nullopt) };
+            const size_t bodyBlock{ newBlock() };
+            const size_t exitBlock{ newBlock() };
+            terminate({ .kind = IrTerm::Kind::BRANCH, .value = cond, .target = bodyBlock, .elseTarget = exitBlock });
+
+            mCurrent = bodyBlock;
+            lowerScope(stmt.b);
+            terminate({ .kind = IrTerm::Kind::JMP, .target = headerBlock });
+
+            mCurrent = exitBlock;
+            break;
+        }
+
+        case NodeKind::SCOPE:
+            lowerScope(index);
+            break;
+
+        default:
+            break; // expressions aren't statements
+        }
+    }
+
+    size_t newBlock() {
+        mFn.blocks.emplace_back();
+        return mFn.blocks.size() - 1;
+    }
+
+    void emit(const IrInstr &instr) {
+        mFn.blocks[mCurrent].instrs.push_back(instr);
+        mFn.blocks[mCurrent].instrs.back().line = mLine;
+    }
+
+    void terminate(const IrTerm &term) {
+        mFn.blocks[mCurrent].term = term;
+        mFn.blocks[mCurrent].term.line = mLine;
+    }
+
+    IrFunction mFn{};
+    size_t mCurrent{};
+    int mLine{}; // of the statement being lowered
+    const FlatAst *mAst{};
+    std::vector<size_t> mRegNeeds{}; // by node
+
+    std::unordered_map<std::string_view, Vreg> mVars{};
+    std::stack<std::string_view, std::vector<std::string_view>> mVarOrder{};
+    std::stack<size_t, std::vector<size_t>> mScopes{};
+};
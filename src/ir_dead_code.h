@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include "ir.h"
+
+// Folds branches on constants into jumps, removes the blocks that leaves unreachable and
+// deletes instructions and phis whose results nothing needs. A result is needed when a
+// terminator uses it or a needed instruction reads it; a division by anything but a nonzero
+// constant is always kept, as it may trap. Needs SSA form, where each register has one
+// definition.
+class IrDeadCode {
+public:
+    IrDeadCode(const IrDeadCode &) = delete;
+    IrDeadCode &operator=(const IrDeadCode &) = delete;
+
+    IrDeadCode() = default;
+
+    void run(IrFunction &fn) {
+        for (IrBlock &block : fn.blocks) {
+            IrTerm &term{ block.term };
+            if (term.kind == IrTerm::Kind::BRANCH && term.value.isImm()) {
+                term = { .kind = IrTerm::Kind::JMP, .target = term.value.value ? term.target : term.elseTarget };
+            }
+        }
+        removeUnreachableBlocks(fn);
+
+        mDefs.assign(fn.vregCount, nullptr);
+        mPhiDefs.assign(fn.vregCount, nullptr);
+        mNeeded.assign(fn.vregCount, false);
+        mWorklist.clear();
+        for (IrBlock &block : fn.blocks) {
+            for (const IrPhi &phi : block.phis) {
+                mPhiDefs[phi.dst] = &phi;
+            }
+            for (const IrInstr &instr : block.instrs) {
+                mDefs[instr.dst] = &instr;
+                if (mayTrap(instr)) {
+                    need(IrOperand::v(instr.dst));
+                }
+            }
+            need(block.term.value);
+        }
+
+        while (!mWorklist.empty()) {
+            const Vreg vreg{ mWorklist.back() };
+            mWorklist.pop_back();
+            if (const IrInstr *const instr{ mDefs[vreg] }) {
+                need(instr->a);
+                need(instr->b);
+            }
+            if (const IrPhi *const phi{ mPhiDefs[vreg] }) {
+                for (const IrOperand &arg : phi->args) {
+                    need(arg);
+                }
+            }
+        }
+
+        for (IrBlock &block : fn.blocks) {
+            std::erase_if(block.instrs, [this](const IrInstr &instr) { return !mNeeded[instr.dst]; });
+            std::erase_if(block.phis, [this](const IrPhi &phi) { return !mNeeded[phi.dst]; });
+        }
+    }
+
+private:
+    static bool mayTrap(const IrInstr &instr) {
+        return instr.op == IrOp::DIV && !(instr.b.isImm() && instr.b.value != 0);
+    }
+
+    void need(const IrOperand &operand) {
+        if (operand.isVreg() && !mNeeded[operand.vreg()]) {
+            mNeeded[operand.vreg()] = true;
+            mWorklist.push_back(operand.vreg());
+        }
+    }
+
+    std::vector<const IrInstr *> mDefs{};
+    std::vector<const IrPhi *> mPhiDefs{};
+    std::vector<bool> mNeeded{};
+    std::vector<Vreg> mWorklist{};
+};
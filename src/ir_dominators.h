@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdlib> // size_t
+#include <vector>
+
+#include "ir.h"
+
+struct DomTree {
+    std::vector<size_t> rpo{}; // reverse postorder of the blocks
+    std::vector<size_t> idom{}; // the entry is its own immediate dominator
+    std::vector<std::vector<size_t>> children{};
+    std::vector<std::vector<size_t>> frontier{};
+};
+
+// Whether `a` dominates `b`
+inline bool dominates(const DomTree &tree, const size_t a, size_t b) {
+    while (b != a && tree.idom[b] != b) {
+        b = tree.idom[b];
+    }
+    return b == a;
+}
+
+// Dominators with the iterative algorithm of Cooper, Harvey & Kennedy ("A Simple, Fast
+// Dominance Algorithm") and the dominance frontiers from the same paper. Every block has
+// to be reachable from the entry.
+class Dominators {
+public:
+    Dominators(const Dominators &) = delete;
+    Dominators &operator=(const Dominators &) = delete;
+
+    Dominators() = default;
+
+    [[nodiscard]] DomTree analyze(const IrFunction &fn) {
+        const size_t blockCount{ fn.blocks.size() };
+        DomTree tree{};
+        tree.rpo = reversePostorder(fn);
+
+        std::vector<size_t> rpoIndex(blockCount);
+        for (size_t i{ 0 }; i < tree.rpo.size(); ++i) {
+            rpoIndex[tree.rpo[i]] = i;
+        }
+
+        tree.idom.assign(blockCount, UNDEFINED);
+        tree.idom[0] = 0;
+        const auto intersect{ [&](size_t a, size_t b) {
+            while (a != b) {
+                while (rpoIndex[a] > rpoIndex[b]) {
+                    a = tree.idom[a];
+                }
+                while (rpoIndex[b] > rpoIndex[a]) {
+                    b = tree.idom[b];
+                }
+            }
+            return a;
+        } };
+
+        for (bool changed{ true }; changed; ) {
+            changed = false;
+            for (size_t i{ 1 }; i < tree.rpo.size(); ++i) {
+                const size_t block{ tree.rpo[i] };
+                size_t newIdom{ UNDEFINED };
+                for (const size_t pred : fn.blocks[block].preds) {
+                    if (tree.idom[pred] == UNDEFINED) {
+                        continue;
+                    }
+                    newIdom = newIdom == UNDEFINED ? pred : intersect(pred, newIdom);
+                }
+                if (tree.idom[block] != newIdom) {
+                    tree.idom[block] = newIdom;
+                    changed = true;
+                }
+            }
+        }
+
+        tree.children.resize(blockCount);
+        for (size_t i{ 1 }; i < tree.rpo.size(); ++i) {
+            tree.children[tree.idom[tree.rpo[i]]].push_back(tree.rpo[i]);
+        }
+
+        tree.frontier.resize(blockCount);
+        for (size_t block{ 0 }; block < blockCount; ++block) {
+            const std::vector<size_t> &preds{ fn.blocks[block].preds };
+            if (preds.size() < 2) {
+                continue;
+            }
+            for (const size_t pred : preds) {
+                for (size_t runner{ pred }; runner != tree.idom[block]; runner = tree.idom[runner]) {
+                    std::vector<size_t> &frontier{ tree.frontier[runner] };
+                    if (frontier.empty() || frontier.back() != block) {
+                        frontier.push_back(block);
+                    }
+                }
+            }
+        }
+
+        return tree;
+    }
+
+private:
+    static constexpr size_t UNDEFINED{ static_cast<size_t>(-1) };
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdint> // uint32_t, uint64_t
+#include <cstdlib> // size_t
+#include <limits>
+#include <utility> // std::move
+#include <vector>
+
+#include "ir.h"
+
+// Live-in and live-out sets of every block. Only registers that cross a block boundary
+// are tracked, so temporaries local to a block cost nothing.
+class IrLiveSets {
+public:
+    [[nodiscard]] bool liveIn(const size_t block, const Vreg vreg) const {
+        return test(mIn[block], vreg);
+    }
+
+    [[nodiscard]] bool liveOut(const size_t block, const Vreg vreg) const {
+        return test(mOut[block], vreg);
+    }
+
+    [[nodiscard]] std::vector<Vreg> liveInList(const size_t block) const {
+        return list(mIn[block]);
+    }
+
+    [[nodiscard]] std::vector<Vreg> liveOutList(const size_t block) const {
+        return list(mOut[block]);
+    }
+
+private:
+    friend class IrLiveness;
+
+    using Bits = std::vector<uint64_t>;
+
+    static constexpr uint32_t UNTRACKED{ std::numeric_limits<uint32_t>::max() };
+
+    [[nodiscard]] bool test(const Bits &bits, const Vreg vreg) const {
+        const uint32_t index{ vreg < mIndex.size() ? mIndex[vreg] : UNTRACKED };
+        return index != UNTRACKED && (bits[index / 64] >> (index % 64) & 1);
+    }
+
+    [[nodiscard]] std::vector<Vreg> list(const Bits &bits) const {
+        std::vector<Vreg> vregs{};
+        for (size_t word{ 0 }; word < bits.size(); ++word) {
+            for (uint64_t rest{ bits[word] }; rest; rest &= rest - 1) {
+                vregs.push_back(mTracked[word * 64 + static_cast<size_t>(__builtin_ctzll(rest))]);
+            }
+        }
+        return vregs;
+    }
+
+    std::vector<Vreg> mTracked{}; // bit index -> register
+    std::vector<uint32_t> mIndex{}; // register -> bit index
+    std::vector<Bits> mIn{};
+    std::vector<Bits> mOut{};
+};
+
+// Backward dataflow over the blocks. In SSA form a phi defines its register at the top of
+// its block and uses each argument at the end of the matching predecessor.
+class IrLiveness {
+public:
+    IrLiveness(const IrLiveness &) = delete;
+    IrLiveness &operator=(const IrLiveness &) = delete;
+
+    IrLiveness() = default;
+
+    [[nodiscard]] IrLiveSets analyze(const IrFunction &fn) {
+        const size_t blockCount{ fn.blocks.size() };
+        IrLiveSets sets{};
+        sets.mIndex.assign(fn.vregCount, IrLiveSets::UNTRACKED);
+
+        // upward-exposed uses and definitions, tracking whatever is used before being defined
+        std::vector<std::vector<Vreg>> uses(blockCount);
+        std::vector<std::vector<Vreg>> defs(blockCount);
+        std::vector<size_t> definedIn(fn.vregCount, blockCount);
+        for (size_t b{ 0 }; b < blockCount; ++b) {
+            const IrBlock &block{ fn.blocks[b] };
+            const auto use{ [&](const IrOperand &operand) {
+                if (operand.isVreg() && definedIn[operand.vreg()] != b) {
+                    uses[b].push_back(operand.vreg());
+                    track(sets, operand.vreg());
+                }
+            } };
+            for (const IrPhi &phi : block.phis) {
+                definedIn[phi.dst] = b;
+                defs[b].push_back(phi.dst);
+            }
+            for (const IrInstr &instr : block.instrs) {
+                use(instr.a);
+                use(instr.b);
+                definedIn[instr.dst] = b;
+                defs[b].push_back(instr.dst);
+            }
+            use(block.term.value);
+            for (const IrPhi &phi : block.phis) { // reset for the next blocks
+                definedIn[phi.dst] = blockCount;
+            }
+            for (const IrInstr &instr : block.instrs) {
+                definedIn[instr.dst] = blockCount;
+            }
+        }
+        for (const IrBlock &block : fn.blocks) {
+            for (const IrPhi &phi : block.phis) {
+                for (const IrOperand &arg : phi.args) {
+                    if (arg.isVreg()) {
+                        track(sets, arg.vreg());
+                    }
+                }
+            }
+        }
+
+        const size_t words{ (sets.mTracked.size() + 63) / 64 };
+        std::vector<IrLiveSets::Bits> gen(blockCount, IrLiveSets::Bits(words));
+        std::vector<IrLiveSets::Bits> kill(blockCount, IrLiveSets::Bits(words));
+        std::vector<IrLiveSets::Bits> phiUses(blockCount, IrLiveSets::Bits(words)); // needed at the end
+        for (size_t b{ 0 }; b < blockCount; ++b) {
+            for (const Vreg vreg : uses[b]) {
+                set(sets, gen[b], vreg);
+            }
+            for (const Vreg vreg : defs[b]) {
+                set(sets, kill[b], vreg);
+            }
+            const IrBlock &block{ fn.blocks[b] };
+            for (const IrPhi &phi : block.phis) {
+                for (size_t i{ 0 }; i < phi.args.size(); ++i) {
+                    if (phi.args[i].isVreg()) {
+                        set(sets, phiUses[block.preds[i]], phi.args[i].vreg());
+                    }
+                }
+            }
+        }
+
+        sets.mIn.assign(blockCount, IrLiveSets::Bits(words));
+        sets.mOut.assign(blockCount, IrLiveSets::Bits(words));
+        const std::vector<size_t> order{ reversePostorder(fn) };
+        for (bool changed{ true }; changed; ) {
+            changed = false;
+            for (auto it{ order.crbegin() }; it != order.crend(); ++it) {
+                const size_t b{ *it };
+                IrLiveSets::Bits out{ phiUses[b] };
+                for (const size_t succ : successors(fn.blocks[b])) {
+                    const IrLiveSets::Bits &succIn{ sets.mIn[succ] };
+                    for (size_t w{ 0 }; w < words; ++w) {
+                        out[w] |= succIn[w];
+                    }
+                }
+                IrLiveSets::Bits in(words);
+                for (size_t w{ 0 }; w < words; ++w) {
+                    in[w] = gen[b][w] | (out[w] & ~kill[b][w]);
+                }
+                if (in != sets.mIn[b] || out != sets.mOut[b]) {
+                    sets.mIn[b] = std::move(in);
+                    sets.mOut[b] = std::move(out);
+                    changed = true;
+                }
+            }
+        }
+
+        return sets;
+    }
+
+private:
+    static void track(IrLiveSets &sets, const Vreg vreg) {
+        if (sets.mIndex[vreg] == IrLiveSets::UNTRACKED) {
+            sets.mIndex[vreg] = static_cast<uint32_t>(sets.mTracked.size());
+            sets.mTracked.push_back(vreg);
+        }
+    }
+
+    static void set(const IrLiveSets &sets, IrLiveSets::Bits &bits, const Vreg vreg) {
+        const uint32_t index{ sets.mIndex[vreg] };
+        if (index != IrLiveSets::UNTRACKED) {
+            bits[index / 64] |= uint64_t{ 1 } << (index % 64);
+        }
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm> // std::sort
+#include <cstdlib> // size_t
+#include <vector>
+
+#include "ir.h"
+#include "ir_dominators.h"
+
+// A natural loop: the blocks that reach a back edge into the header without passing it
+struct NaturalLoop {
+    size_t header{};
+    std::vector<bool> body{}; // per block, the header included
+    size_t blockCount{};
+};
+
+// The natural loops of the function, one per header, with the loops nested in another
+// coming before it. Every block has to be reachable from the entry.
+inline std::vector<NaturalLoop> findLoops(const IrFunction &fn, const DomTree &tree) {
+    std::vector<NaturalLoop> loops{};
+    std::vector<size_t> loopOf(fn.blocks.size(), fn.blocks.size()); // index by header
+    for (const size_t latch : tree.rpo) {
+        for (const size_t header : successors(fn.blocks[latch])) {
+            if (!dominates(tree, header, latch)) {
+                continue;
+            }
+            if (loopOf[header] == fn.blocks.size()) {
+                loopOf[header] = loops.size();
+                loops.push_back({ .header = header, .body = std::vector<bool>(fn.blocks.size()) });
+                loops.back().body[header] = true;
+                loops.back().blockCount = 1;
+            }
+            NaturalLoop &loop{ loops[loopOf[header]] };
+            std::vector<size_t> worklist{ latch };
+            while (!worklist.empty()) {
+                const size_t block{ worklist.back() };
+                worklist.pop_back();
+                if (loop.body[block]) {
+                    continue;
+                }
+                loop.body[block] = true;
+                ++loop.blockCount;
+                worklist.insert(worklist.end(), fn.blocks[block].preds.cbegin(), fn.blocks[block].preds.cend());
+            }
+        }
+    }
+
+    // a loop nested in another has fewer blocks
+    std::sort(loops.begin(), loops.end(), [](const NaturalLoop &a, const NaturalLoop &b) {
+        return a.blockCount < b.blockCount;
+    });
+    return loops;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <cstdint> // int64_t, uint8_t, uint64_t
+#include <cstdlib> // size_t
+#include <cstring> // std::memcpy
+#include <vector>
+
+#include "error.h"
+
+// Machine code copied into an executable mapping and called as `int64_t()`
+class JitFunction {
+public:
+    JitFunction() = delete;
+    JitFunction(const JitFunction &) = delete;
+    JitFunction &operator=(const JitFunction &) = delete;
+
+    explicit JitFunction(const std::vector<uint8_t> &code) : mSize{ code.empty() ? 1 : code.size() } {
+        void *const memory{ mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) };
+        if (memory == MAP_FAILED) {
+            error("[JIT Error] Cannot map memory for the code");
+        }
+        std::memcpy(memory, code.data(), code.size());
+
+        // W^X: the mapping is never writable and executable at the same time
+        if (mprotect(memory, mSize, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, mSize);
+            error("[JIT Error] Cannot make the code executable");
+        }
+        mMemory = memory;
+    }
+
+    ~JitFunction() {
+        munmap(mMemory, mSize);
+    }
+
+    [[nodiscard]] uint64_t address() const {
+        return reinterpret_cast<uint64_t>(mMemory);
+    }
+
+    int64_t operator()() const {
+        using Entry = int64_t (*)();
+        return reinterpret_cast<Entry>(mMemory)();
+    }
+
+private:
+    size_t mSize{};
+    void *mMemory{};
+};
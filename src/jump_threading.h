@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdlib> // size_t
+
+#include "ir.h"
+
+// Threads jumps through empty blocks: an edge into a block with nothing but a `jmp` goes
+// straight to where that block jumps, and a `jmp` into an empty exiting block becomes the
+// exit itself. Blocks bumping profile counters aren't empty. A branch with both edges to
+// the same block becomes a `jmp`. Blocks left without predecessors are removed.
+class JumpThreading {
+public:
+    JumpThreading(const JumpThreading &) = delete;
+    JumpThreading &operator=(const JumpThreading &) = delete;
+
+    JumpThreading() = default;
+
+    void run(IrFunction &fn) {
+        for (IrBlock &block : fn.blocks) {
+            IrTerm &term{ block.term };
+            switch (term.kind) {
+            case IrTerm::Kind::JMP:
+                term.target = finalTarget(fn, term.target);
+                if (isEmptyExit(fn.blocks[term.target])) {
+                    term = fn.blocks[term.target].term;
+                }
+                break;
+
+            case IrTerm::Kind::BRANCH:
+                term.target = finalTarget(fn, term.target);
+                term.elseTarget = finalTarget(fn, term.elseTarget);
+                if (term.target == term.elseTarget) {
+                    term = { .kind = IrTerm::Kind::JMP, .target = term.target };
+                }
+                break;
+
+            case IrTerm::Kind::EXIT:
+                break;
+            }
+        }
+
+        removeUnreachableBlocks(fn);
+    }
+
+private:
+    static bool isEmptyJump(const IrBlock &block) {
+        return block.phis.empty() && block.instrs.empty() && block.counters.empty() && block.term.kind == IrTerm::Kind::JMP;
+    }
+
+    static bool isEmptyExit(const IrBlock &block) {
+        return block.phis.empty() && block.instrs.empty() && block.counters.empty() && block.term.kind == IrTerm::Kind::EXIT;
+    }
+
+    // End of the chain of empty jumping blocks starting at `block`
+    static size_t finalTarget(const IrFunction &fn, size_t block) {
+        for (size_t steps{ 0 }; isEmptyJump(fn.blocks[block]) && steps < fn.blocks.size(); ++steps) { // stops on cycles
+            block = fn.blocks[block].term.target;
+        }
+        return block;
+    }
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Where the code of a source line starts
+struct LineEntry {
+    size_t offset{}; // in the code
+    int line{};
+};
+
+// Stretch of code generated for one source line; line 0 is the code before the first
+// statement
+struct LineRegion {
+    size_t start{};
+    size_t size{};
+    int line{};
+};
+
+// The regions the entries divide the code into, merging the neighbours of the same line
+inline std::vector<LineRegion> lineRegions(const std::vector<LineEntry> &entries, const size_t codeSize) {
+    std::vector<LineRegion> regions{ { .start = 0 } };
+    for (const LineEntry &entry : entries) {
+        if (entry.line == regions.back().line) {
+            continue;
+        }
+        regions.back().size = entry.offset - regions.back().start;
+        regions.push_back({ .start = entry.offset, .line = entry.line });
+    }
+    regions.back().size = codeSize - regions.back().start;
+    std::erase_if(regions, [](const LineRegion &region) { return region.size == 0; });
+    return regions;
+}
+
+// Symbol of a region, like `test.code:12`; the code before the first statement is the entry
+inline std::string regionName(const std::string &source, const int line) {
+    return line == 0 ? "_start" : source + ":" + std::to_string(line);
+}
+
+// Contents of a `/tmp/perf-<pid>.map` file, which lets perf name the code the JIT mapped at `base`
+inline std::string perfMap(const uint64_t base, const std::vector<LineRegion> &regions, const std::string &source) {
+    std::stringstream out{};
+    out << std::hex;
+    for (const LineRegion &region : regions) {
+        out << base + region.start << ' ' << region.size << ' ' << regionName(source, region.line) << '\n';
+    }
+    return out.str();
+}
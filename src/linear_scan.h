@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm> // std::sort, std::min_element
+#include <cstdlib> // size_t
+#include <numeric> // std::iota
+#include <optional>
+#include <utility> // std::move
+#include <vector>
+
+#include "x86.h"
+
+// Inclusive range of program points where a value must keep its location
+struct LiveInterval {
+    size_t start{};
+    size_t end{};
+    size_t weight{}; // spill cost, e.g. the number of uses
+};
+
+// Linear-scan register allocation (Poletto & Sarkar). Under pressure the interval with
+// the lowest spill cost is spilled, ties going to the one that ends last.
+class LinearScan {
+public:
+    LinearScan() = delete;
+    LinearScan(const LinearScan &) = delete;
+    LinearScan &operator=(const LinearScan &) = delete;
+
+    explicit LinearScan(std::vector<Reg> regs) : mRegs{ std::move(regs) } {}
+
+    // Returns a register per interval, or nothing for the spilled ones
+    [[nodiscard]] std::vector<std::optional<Reg>> allocate(const std::vector<LiveInterval> &intervals) {
+        std::vector<std::optional<Reg>> assignment(intervals.size());
+        std::vector<size_t> order(intervals.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&intervals](const size_t a, const size_t b) {
+            return intervals[a].start < intervals[b].start;
+        });
+
+        std::vector<Reg> freeRegs{ mRegs.rbegin(), mRegs.rend() }; // hand out in the given order
+        std::vector<size_t> active{};
+
+        for (const size_t current : order) {
+            // expire intervals that ended before this one starts
+            std::erase_if(active, [&](const size_t other) {
+                if (intervals[other].end < intervals[current].start) {
+                    freeRegs.push_back(*assignment[other]);
+                    return true;
+                }
+                return false;
+            });
+
+            if (!freeRegs.empty()) {
+                assignment[current] = freeRegs.back();
+                freeRegs.pop_back();
+                active.push_back(current);
+                continue;
+            }
+
+            const auto cheaper{ [&intervals](const size_t a, const size_t b) {
+                if (intervals[a].weight != intervals[b].weight) {
+                    return intervals[a].weight < intervals[b].weight;
+                }
+                return intervals[a].end > intervals[b].end;
+            } };
+            const auto victim{ std::min_element(active.begin(), active.end(), cheaper) };
+            if (victim == active.end() || !cheaper(*victim, current)) {
+                continue; // spill the current interval
+            }
+
+            assignment[current] = assignment[*victim];
+            assignment[*victim].reset();
+            *victim = current;
+        }
+
+        return assignment;
+    }
+
+private:
+    std::vector<Reg> mRegs{};
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdlib> // size_t
+#include <optional>
+#include <vector>
+
+#include "ir.h"
+#include "ir_dominators.h"
+#include "ir_loops.h"
+
+// Hoists the instructions of a loop whose operands are all computed outside it into the
+// block that enters the loop, so they run once instead of on every iteration. Inner loops
+// go first, which lets an instruction move out through several levels. A division is only
+// hoisted by a nonzero constant, as the loop might not have run it. Loops entered from more
+// than one block, or from a block that also branches elsewhere, are left alone; the IR
+// builder always enters a loop with a jump. With a profile, blocks that ran less often than
+// the preheader, like a rarely taken branch or a loop that mostly doesn't iterate, keep
+// their instructions. Needs SSA form, where each register has one definition.
+class LoopInvariantCodeMotion {
+public:
+    LoopInvariantCodeMotion(const LoopInvariantCodeMotion &) = delete;
+    LoopInvariantCodeMotion &operator=(const LoopInvariantCodeMotion &) = delete;
+
+    LoopInvariantCodeMotion() = default;
+
+    void run(IrFunction &fn) {
+        removeUnreachableBlocks(fn);
+        const DomTree tree{ Dominators{}.analyze(fn) };
+
+        mDefBlock.assign(fn.vregCount, UNDEFINED);
+        for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+            for (const IrPhi &phi : fn.blocks[b].phis) {
+                mDefBlock[phi.dst] = b;
+            }
+            for (const IrInstr &instr : fn.blocks[b].instrs) {
+                mDefBlock[instr.dst] = b;
+            }
+        }
+
+        for (const NaturalLoop &loop : findLoops(fn, tree)) {
+            if (const std::optional<size_t> preheader{ preheaderOf(fn, loop) }) {
+                hoist(fn, tree, loop, *preheader);
+            }
+        }
+    }
+
+private:
+    static constexpr size_t UNDEFINED{ static_cast<size_t>(-1) };
+
+    // The only block outside the loop that enters it, if it does nothing else
+    static std::optional<size_t> preheaderOf(const IrFunction &fn, const NaturalLoop &loop) {
+        std::optional<size_t> preheader{};
+        for (const size_t pred : fn.blocks[loop.header].preds) {
+            if (loop.body[pred]) {
+                continue;
+            }
+            if (preheader || fn.blocks[pred].term.kind != IrTerm::Kind::JMP) {
+                return std::nullopt;
+            }
+            preheader = pred;
+        }
+        return preheader;
+    }
+
+    bool isInvariant(const IrOperand &operand, const NaturalLoop &loop) const {
+        return !operand.isVreg() || mDefBlock[operand.vreg()] == UNDEFINED || !loop.body[mDefBlock[operand.vreg()]];
+    }
+
+    // Walks the loop in reverse postorder, so an operand's definition is seen before its uses
+    void hoist(IrFunction &fn, const DomTree &tree, const NaturalLoop &loop, const size_t preheader) {
+        for (const size_t b : tree.rpo) {
+            if (!loop.body[b] || (fn.profiled && fn.blocks[b].count < fn.blocks[preheader].count)) {
+                continue;
+            }
+            std::erase_if(fn.blocks[b].instrs, [&](const IrInstr &instr) {
+                const bool mayTrap{ instr.op == IrOp::DIV && !(instr.b.isImm() && instr.b.value != 0) };
+                if (mayTrap || !isInvariant(instr.a, loop) || !isInvariant(instr.b, loop)) {
+                    return false;
+                }
+                fn.blocks[preheader].instrs.push_back(instr);
+                mDefBlock[instr.dst] = preheader;
+                return true;
+            });
+        }
+    }
+
+    std::vector<size_t> mDefBlock{}; // block defining each register
+};
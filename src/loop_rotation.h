@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm> // std::min
+#include <cstdlib> // size_t
+#include <vector>
+
+#include "ir.h"
+#include "ir_dominators.h"
+
+// Rotates loops so their condition is checked at the bottom: a block that jumps back to a
+// loop header ending in a branch gets a copy of the header's instructions and branch, with
+// temporaries of its own. The header then only runs once, as the guard in front of the
+// loop, and each iteration takes a single branch instead of a jump and a branch. Headers of
+// more than MAX_HEADER_SIZE instructions aren't copied. The copy bumps the header's profile
+// counters too, and the header's count keeps only the runs that don't come from the latch.
+// Needs normal form, where a register may be defined on several paths.
+class LoopRotation {
+public:
+    LoopRotation(const LoopRotation &) = delete;
+    LoopRotation &operator=(const LoopRotation &) = delete;
+
+    LoopRotation() = default;
+
+    static constexpr size_t MAX_HEADER_SIZE{ 8 };
+
+    void run(IrFunction &fn) {
+        removeUnreachableBlocks(fn);
+        const DomTree tree{ Dominators{}.analyze(fn) };
+
+        for (size_t latch{ 0 }; latch < fn.blocks.size(); ++latch) {
+            const IrTerm term{ fn.blocks[latch].term };
+            if (term.kind != IrTerm::Kind::JMP || term.target == latch || !dominates(tree, term.target, latch)) {
+                continue;
+            }
+            IrBlock &header{ fn.blocks[term.target] };
+            if (header.term.kind != IrTerm::Kind::BRANCH || header.instrs.size() > MAX_HEADER_SIZE) {
+                continue;
+            }
+            IrBlock &block{ fn.blocks[latch] };
+            IrTerm copyTerm{ header.term };
+            const std::vector<IrInstr> copy{ cloneInstrs(fn, header, copyTerm) };
+            block.instrs.insert(block.instrs.end(), copy.cbegin(), copy.cend());
+            block.counters.insert(block.counters.end(), header.counters.cbegin(), header.counters.cend());
+            block.term = copyTerm;
+            header.count -= std::min(header.count, block.count);
+        }
+
+        computePreds(fn);
+    }
+};
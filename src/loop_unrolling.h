@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm> // std::min
+#include <cstdlib> // size_t
+#include <utility> // std::move
+#include <vector>
+
+#include "ir.h"
+
+// Unrolls the loops made of a single block that branches back to itself, which rotation
+// leaves for small bodies. The block is chained with up to MAX_FACTOR - 1 copies of itself,
+// each keeping its exit and with temporaries of its own, so the trip count doesn't need to
+// be known; the loop then only branches back once per MAX_FACTOR iterations and the copies
+// fall through into each other. Loops stay within MAX_UNROLLED_SIZE instructions. With a
+// profile, loops that never ran are left as they are and the copies share the count. Needs
+// normal form, where a register may be defined in several blocks.
+class LoopUnrolling {
+public:
+    LoopUnrolling(const LoopUnrolling &) = delete;
+    LoopUnrolling &operator=(const LoopUnrolling &) = delete;
+
+    LoopUnrolling() = default;
+
+    static constexpr size_t MAX_FACTOR{ 4 };
+    static constexpr size_t MAX_UNROLLED_SIZE{ 32 };
+
+    void run(IrFunction &fn) {
+        const size_t blockCount{ fn.blocks.size() };
+        for (size_t loop{ 0 }; loop < blockCount; ++loop) {
+            const IrTerm term{ fn.blocks[loop].term };
+            if (term.kind != IrTerm::Kind::BRANCH || (term.target == loop) == (term.elseTarget == loop)) {
+                continue;
+            }
+            if (fn.profiled && fn.blocks[loop].count == 0) {
+                continue;
+            }
+            const size_t size{ std::max<size_t>(fn.blocks[loop].instrs.size(), 1) };
+            const size_t factor{ std::min(MAX_FACTOR, MAX_UNROLLED_SIZE / size) };
+            if (factor < 2) {
+                continue;
+            }
+
+            // each copy continues into the next one, the last back into the original
+            fn.blocks[loop].count = (fn.blocks[loop].count + factor - 1) / factor;
+            size_t previous{ loop };
+            for (size_t i{ 1 }; i < factor; ++i) {
+                const size_t copy{ fn.blocks.size() };
+                const IrBlock &original{ fn.blocks[loop] };
+                IrTerm copyTerm{ term };
+                std::vector<IrInstr> instrs{ cloneInstrs(fn, original, copyTerm) };
+                fn.blocks.push_back({ .instrs = std::move(instrs), .term = copyTerm, .counters = original.counters, .count = original.count });
+                retarget(fn.blocks[previous].term, loop, copy);
+                previous = copy;
+            }
+        }
+
+        computePreds(fn);
+    }
+
+private:
+    static void retarget(IrTerm &term, const size_t from, const size_t to) {
+        if (term.target == from) {
+            term.target = to;
+        } else {
+            term.elseTarget = to;
+        }
+    }
+};
@@ -1,20 +1,42 @@
+#include <unistd.h> // getpid
+
+#include <cstdint> // uint8_t
 #include <iostream>
-#include <fstream>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <utility> // std::move
 #include <vector>
 
+#include "asm_writer.h"
+#include "constant_folder.h"
+#include "dead_code_eliminator.h"
+#include "elf_writer.h"
 #include "error.h"
+#include "file_io.h"
 #include "generator.h"
+#include "interpreter.h"
+#include "ir.h"
+#include "ir_builder.h"
+#include "jit.h"
+#include "line_table.h"
+#include "parallel_tokenizer.h"
 #include "parser.h"
+#include "pass_manager.h"
+#include "peephole.h"
+#include "profile.h"
+#include "token_pipe.h"
 #include "tokenizer.h"
+#include "x86_encoder.h"
 
 //===========================================================================
 // Hardcoded
 constexpr char ASM_PATH[]{ "out.asm" };
+constexpr char IR_PATH[]{ "out.ir" };
 constexpr char OBJ_PATH[]{ "out.o" };
 constexpr char OUTNAME[]{ "out" };
+constexpr char PROFILE_PATH[]{ "out.profile" };
 
 //===========================================================================
 // Compiler
@@ -34,38 +56,228 @@ void callLinker(const char *const filename, const char *const outname) {
 
 //===========================================================================
 // Work with files
-std::string readFile(const char *const filename) {
-    const std::ifstream input{ filename };
-    std::stringstream contentsStream{};
-    contentsStream << input.rdbuf();
-    return contentsStream.str();
+void writeFile(const char *const filename, const std::string_view contents) {
+    FileWriter file{ filename };
+    file.write(contents);
+}
+
+void writeExecutable(const char *const filename, const std::vector<uint8_t> &image) {
+    FileWriter file{ filename, 0755 };
+    file.write(image.data(), image.size());
+}
+
+//===========================================================================
+// Command line
+struct Options {
+    const char *input{};
+    bool emitAsm{}; // dump the generated assembly to `out.asm`
+    bool emitIr{}; // dump the optimized IR to `out.ir`
+    bool useNasm{}; // assemble and link with nasm + ld instead of the built-in ELF writer
+    bool run{}; // execute in-process and exit with the program's exit value
+    bool interpret{}; // run on the bytecode interpreter instead of native code
+    bool optimize{ true }; // run the AST and peephole optimizations
+    bool stats{}; // report what the optimizations did to stderr
+    bool instrument{}; // count block runs into `out.profile`
+    const char *profileUse{}; // profile to optimize with
+    bool perfMap{}; // describe the JIT code in `/tmp/perf-<pid>.map`
+    bool streamTokens{}; // parse while the tokenizer runs, keeping only a window of tokens
+    std::optional<std::vector<std::string>> passes{}; // the default pipeline unless given
+    std::optional<std::vector<std::string>> peepholeRules{}; // all rules unless given
+};
+
+std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> items{};
+    std::stringstream stream{ list };
+    for (std::string item{}; std::getline(stream, item, ',');) {
+        if (!item.empty()) {
+            items.push_back(std::move(item));
+        }
+    }
+    return items;
+}
+
+Options parseArgs(const int argc, char **const argv) {
+    constexpr char USAGE[]{ "Usage: compile [--emit-asm] [--emit-ir] [--nasm | --run | --interpret] [--no-opt] [--passes=<pass,...>] [--peephole=<rule,...>] [--stats] [--instrument | --profile-use=<file>] [--perf-map] [--stream-tokens] <input.code>" };
+
+    Options options{};
+    for (int i{ 1 }; i < argc; ++i) {
+        const std::string arg{ argv[i] };
+        if (arg == "--emit-asm") {
+            options.emitAsm = true;
+        } else if (arg == "--emit-ir") {
+            options.emitIr = true;
+        } else if (arg == "--nasm") {
+            options.useNasm = true;
+        } else if (arg == "--run") {
+            options.run = true;
+        } else if (arg == "--interpret") {
+            options.interpret = true;
+        } else if (arg == "--no-opt") {
+            options.optimize = false;
+        } else if (arg.starts_with("--passes=")) {
+            options.passes = splitList(arg.substr(std::string{ "--passes=" }.size()));
+        } else if (arg.starts_with("--peephole=")) {
+            options.peepholeRules = splitList(arg.substr(std::string{ "--peephole=" }.size()));
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--instrument") {
+            options.instrument = true;
+        } else if (arg == "--perf-map") {
+            options.perfMap = true;
+        } else if (arg == "--stream-tokens") {
+            options.streamTokens = true;
+        } else if (arg.starts_with("--profile-use=")) {
+            options.profileUse = argv[i] + std::string{ "--profile-use=" }.size();
+        } else if (arg.starts_with("--") || options.input) {
+            error(USAGE);
+        } else {
+            options.input = argv[i];
+        }
+    }
+
+    if (!options.input || options.useNasm + options.run + options.interpret > 1) {
+        error(USAGE);
+    }
+    if ((options.instrument || options.profileUse) && (options.interpret || (options.instrument && options.profileUse))) {
+        error(USAGE);
+    }
+    if (options.perfMap && !options.run) {
+        error(USAGE);
+    }
+
+    return options;
 }
 
-void writeFile(const char *const filename, const std::string &contents) {
-    std::ofstream file{ filename };
-    file << contents;
+//===========================================================================
+// Statistics
+void printArenaStats(const char *const stage, const ArenaStats &stats) {
+    std::cerr << stage << " nodes: " << stats.usedBytes << " bytes used, "
+        << stats.paddingBytes << " bytes of padding, "
+        << stats.chunkCount << " chunks of " << stats.reservedBytes << " bytes\n";
 }
 
 //===========================================================================
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        error("Usage: compile <input.code>");
+    const Options options{ parseArgs(argc, argv) };
+
+    const MappedFile input{ options.input }; // tokens and the tree view it
+
+    const NodeProg *prog{};
+    std::optional<Parser> parser{}; // the parser deallocates the memory
+    std::optional<StreamingParser> streamingParser{};
+    if (options.streamTokens) {
+        prog = streamingParser.emplace(TokenPipe{ input.contents() }).parseProg();
+    } else {
+        const ParallelTokenizer tokenizer{ input.contents(), ParallelTokenizer::defaultThreads(input.contents().size()) };
+        prog = parser.emplace(tokenizer.tokenize()).parseProg();
     }
+    if (options.stats) {
+        printArenaStats("parser", parser ? parser->arenaStats() : streamingParser->arenaStats());
+    }
+
+    ConstantFolder folder{};
+    if (options.optimize) {
+        prog = folder.foldProg(prog);
+        if (options.stats) {
+            const FoldStats &stats{ folder.stats() };
+            std::cerr << "constant folding: " << stats.foldedExprs << " expressions folded, "
+                << stats.propagatedUses << " uses propagated, "
+                << stats.eliminatedNodes << " nodes eliminated\n";
+            printArenaStats("constant folding", folder.arenaStats());
+        }
+    }
+
+    DeadCodeEliminator eliminator{};
+    if (options.optimize) {
+        prog = eliminator.eliminate(prog);
+        if (options.stats) {
+            const DceStats &stats{ eliminator.stats() };
+            std::cerr << "dead code: " << stats.removedStmts << " statements removed, "
+                << stats.prunedBranches << " branches pruned, "
+                << stats.removedLets << " lets removed\n";
+            printArenaStats("dead code", eliminator.arenaStats());
+        }
+    }
+
+    if (options.interpret) {
+        BytecodeCompiler compiler{};
+        const Bytecode bytecode{ compiler.compileProg(prog) };
+        Interpreter interpreter{ bytecode };
+        return static_cast<int>(interpreter.run());
+    }
+
+    Generator generator{ options.run ? ExitMode::RETURN : ExitMode::SYSCALL, PROFILE_PATH };
+    IrBuilder irBuilder{};
+    IrFunction ir{ irBuilder.build(prog) };
+    if (options.instrument) {
+        instrument(ir);
+    } else if (options.profileUse) {
+        const MappedFile profile{ options.profileUse };
+        applyProfile(ir, profile.contents());
+    }
+
+    PassManager passManager{};
+    if (options.passes) {
+        passManager.setPipeline(*options.passes);
+    } else if (!options.optimize) {
+        passManager.setPipeline({});
+    }
+    passManager.run(ir);
+    if (options.stats) {
+        for (const PassTiming &timing : passManager.timings()) {
+            std::cerr << "pass " << timing.name << ": " << timing.milliseconds << " ms\n";
+        }
+    }
+
+    if (options.emitIr) {
+        writeFile(IR_PATH, to_string(ir));
+    }
+
+    InstrList instrs{ generator.genProg(ir) };
 
-    std::string contents{ readFile(argv[1]) };
+    if (options.optimize) {
+        PeepholeOptimizer peephole{};
+        if (options.peepholeRules) {
+            peephole.select(*options.peepholeRules);
+        }
+        peephole.run(instrs);
+        if (options.stats) {
+            std::cerr << "peephole:";
+            for (const PeepholeRule &rule : peephole.rules()) {
+                if (rule.enabled) {
+                    std::cerr << ' ' << rule.name << '=' << rule.hits;
+                }
+            }
+            std::cerr << '\n';
+        }
+    }
 
-    Tokenizer tokenizer{ std::move(contents) };
-    std::vector<Token> tokens{ tokenizer.tokenize() };
+    if (options.emitAsm || options.useNasm) {
+        AsmWriter asmWriter{};
+        writeFile(ASM_PATH, asmWriter.render(instrs));
+    }
 
-    Parser parser{ std::move(tokens) };
-    const NodeProg *const prog{ parser.parseProg() }; // parser deallocates the memory
+    if (options.useNasm) {
+        callAssembler(ASM_PATH);
+        callLinker(OBJ_PATH, OUTNAME);
+        return 0;
+    }
 
-    Generator generator{};
-    const std::string asmCode{ generator.genProg(prog) };
+    X86Encoder encoder{};
+
+    if (options.run) {
+        const std::vector<uint8_t> code{ encoder.encode(instrs) };
+        const JitFunction program{ code };
+        if (options.perfMap) {
+            const std::string mapPath{ "/tmp/perf-" + std::to_string(getpid()) + ".map" };
+            writeFile(mapPath.c_str(), perfMap(program.address(), lineRegions(encoder.lines(), code.size()), options.input));
+        }
+        return static_cast<int>(program());
+    }
 
-    writeFile(ASM_PATH, asmCode);
-    callAssembler(ASM_PATH);
-    callLinker(OBJ_PATH, OUTNAME);
+    const ElfWriter elfWriter{};
+    const std::vector<uint8_t> code{ encoder.encode(instrs) };
+    writeExecutable(OUTNAME, elfWriter.build(code, options.input, encoder.lines()));
 
     return 0;
 }
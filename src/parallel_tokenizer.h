@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm> // std::clamp, std::max
+#include <cstdlib> // size_t
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility> // std::move
+#include <vector>
+
+#include "error.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+// Tokenizes a large source on several threads. The source is cut right after newlines, which
+// can't be inside a token or a `#` comment, so every piece lexes the same as in the whole.
+// Each piece numbers its lines from 1; the newline counts of the pieces before it give the
+// offset that makes its lines match the serial tokenizer's, and the tokens are identical.
+class ParallelTokenizer {
+public:
+    ParallelTokenizer() = delete;
+    ParallelTokenizer(const ParallelTokenizer &) = delete;
+    ParallelTokenizer &operator=(const ParallelTokenizer &) = delete;
+
+    ParallelTokenizer(const std::string_view src, const size_t threadCount) :
+        mSource{ src },
+        mThreadCount{ std::max<size_t>(threadCount, 1) } {}
+
+    // One thread per MIN_PIECE_SIZE of source, up to the number of cores
+    [[nodiscard]] static size_t defaultThreads(const size_t sourceSize) {
+        const size_t cores{ std::max<size_t>(std::thread::hardware_concurrency(), 1) };
+        return std::clamp<size_t>(sourceSize / MIN_PIECE_SIZE, 1, cores);
+    }
+
+    [[nodiscard]] TokenStream tokenize() const {
+        const std::vector<size_t> bounds{ pieceBounds() };
+        if (bounds.size() <= 2) { // one piece
+            Tokenizer tokenizer{ mSource };
+            return tokenizer.tokenize();
+        }
+
+        std::vector<Piece> pieces{};
+        pieces.reserve(bounds.size() - 1);
+        for (size_t i{ 0 }; i + 1 < bounds.size(); ++i) {
+            pieces.push_back({ .tokens = TokenStream{ mSource } });
+        }
+        {
+            std::vector<std::jthread> workers{};
+            for (size_t i{ 0 }; i < pieces.size(); ++i) {
+                workers.emplace_back([this, &piece = pieces[i], begin = bounds[i], end = bounds[i + 1]] {
+                    Tokenizer tokenizer{ mSource };
+                    piece.newlines = tokenizer.tokenize(begin, end, piece.tokens);
+                    piece.failure = tokenizer.failure();
+                });
+            }
+        } // joined
+
+        size_t tokenCount{};
+        for (const Piece &piece : pieces) {
+            if (piece.failure) { // the first error in the source
+                error(*piece.failure);
+            }
+            tokenCount += piece.tokens.size();
+        }
+
+        TokenStream tokens{ std::move(pieces.front().tokens) };
+        tokens.reserve(tokenCount);
+        int lineOffset{ pieces.front().newlines };
+        for (size_t i{ 1 }; i < pieces.size(); ++i) {
+            tokens.append(pieces[i].tokens, lineOffset);
+            lineOffset += pieces[i].newlines;
+        }
+
+        return tokens;
+    }
+
+private:
+    static constexpr size_t MIN_PIECE_SIZE{ 1 << 20 };
+
+    struct Piece {
+        TokenStream tokens;
+        int newlines{};
+        std::optional<std::string> failure{};
+    };
+
+    // Starts of the pieces, each just after a newline, and the end of the source
+    [[nodiscard]] std::vector<size_t> pieceBounds() const {
+        const ScanKernels &kernels{ bestKernels() };
+        std::vector<size_t> bounds{ 0 };
+        for (size_t i{ 1 }; i < mThreadCount; ++i) {
+            const size_t target{ std::max(mSource.size() / mThreadCount * i, bounds.back()) };
+            const size_t newline{ kernels.findNewline(mSource.data(), target, mSource.size()) };
+            if (newline + 1 < mSource.size()) {
+                bounds.push_back(newline + 1);
+            }
+        }
+        bounds.push_back(mSource.size());
+        return bounds;
+    }
+
+    std::string_view mSource{};
+    size_t mThreadCount{};
+};
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint> // uint64_t
 #include <cstdlib> // size_t
 #include <optional>
+#include <string>
+#include <string_view>
 #include <utility> // std::move
 #include <variant>
 #include <vector>
@@ -9,19 +12,26 @@
 #include "arena_allocator.h"
 #include "error.h"
 #include "text_reader.h"
+#include "token_pipe.h"
 #include "tokenizer.h"
 
-constexpr int FOUR_MEGABYTES{ 4 * 1024 * 1024 };
-
 struct NodeExpr;
 struct NodeStmt;
 
+// A name viewed in the source, which outlives the tree
+struct Identifier {
+    std::string_view name{};
+    int ln{};
+};
+
+// Integers are unsigned 64-bit
 struct NodeTermIntLiteral {
-    Token intLiteral{};
+    uint64_t value{};
+    int ln{};
 };
 
 struct NodeTermIdentifier {
-    Token identifier{};
+    Identifier identifier{};
 };
 
 struct NodeTermParen {
@@ -69,6 +79,34 @@ struct NodeExpr {
     std::variant<const NodeTerm *, const NodeBinExpr *> expr{};
 };
 
+// Value of an expression that is a bare integer literal
+inline std::optional<uint64_t> literalValue(const NodeExpr *const expr) {
+    const auto *const term{ std::get_if<const NodeTerm *>(&expr->expr) };
+    if (!term) {
+        return {};
+    }
+    const auto *const intLiteralTerm{ std::get_if<const NodeTermIntLiteral *>(&(*term)->term) };
+    if (!intLiteralTerm) {
+        return {};
+    }
+    return (*intLiteralTerm)->value;
+}
+
+// Line of the leftmost token of an expression
+inline int lineOf(const NodeExpr *const expr) {
+    if (const auto *const binExpr{ std::get_if<const NodeBinExpr *>(&expr->expr) }) {
+        return std::visit([](const auto *const bin) { return lineOf(bin->lhs); }, (*binExpr)->expr);
+    }
+    const NodeTerm *const term{ std::get<const NodeTerm *>(expr->expr) };
+    if (const auto *const parenTerm{ std::get_if<const NodeTermParen *>(&term->term) }) {
+        return lineOf((*parenTerm)->expr);
+    }
+    if (const auto *const identifierTerm{ std::get_if<const NodeTermIdentifier *>(&term->term) }) {
+        return (*identifierTerm)->identifier.ln;
+    }
+    return std::get<const NodeTermIntLiteral *>(term->term)->ln;
+}
+
 struct NodeScope {
     std::vector<const NodeStmt *>stmts{};
 };
@@ -78,12 +116,12 @@ struct NodeStmtExit {
 };
 
 struct NodeStmtLet {
-    Token identifier{};
+    Identifier identifier{};
     const NodeExpr *expr{};
 };
 
 struct NodeStmtAssign {
-    Token identifier{};
+    Identifier identifier{};
     const NodeExpr *expr{};
 };
 
@@ -107,12 +145,18 @@ struct NodeStmtIf {
     const NodeBranchElse *elseBranch{};
 };
 
+struct NodeStmtWhile {
+    const NodeExpr *expr{};
+    const NodeScope *scope{};
+};
+
 struct NodeStmt {
     std::variant<
         const NodeStmtExit *,
         const NodeStmtLet *,
         const NodeStmtAssign *,
         const NodeStmtIf *,
+        const NodeStmtWhile *,
         const NodeScope *
     > stmt{};
 };
@@ -121,23 +165,26 @@ struct NodeProg {
     std::vector<const NodeStmt *> stmts{};
 };
 
-class Parser : public TextReader<std::vector<Token>> {
+// Parses from any token source the TextReader can read: a whole TokenStream, or a TokenPipe
+// that delivers tokens while the tokenizer is still running
+template <typename Tokens>
+class BasicParser : public TextReader<Tokens> {
 public:
-    Parser() = delete;
-    Parser(const Parser &) = delete;
-    Parser &operator=(const Parser &) = delete;
+    BasicParser() = delete;
+    BasicParser(const BasicParser &) = delete;
+    BasicParser &operator=(const BasicParser &) = delete;
 
-    explicit Parser(std::vector<Token> &&tokens) : TextReader{ std::move(tokens) } {}
+    explicit BasicParser(Tokens &&tokens) : TextReader<Tokens>{ std::move(tokens) } {}
 
     const NodeTerm *parseTerm() {
         if (const std::optional<Token> intLiteral{ tryConsume(TokenType::INT_LITERAL) }) {
-            const NodeTermIntLiteral *const intLiteralTerm{ mAllocator.emplace<NodeTermIntLiteral>(*intLiteral) };
+            const NodeTermIntLiteral *const intLiteralTerm{ mAllocator.emplace<NodeTermIntLiteral>(intLiteral->value, intLiteral->ln) };
             const NodeTerm *const term{ mAllocator.emplace<NodeTerm>(intLiteralTerm) };
             return term;
         }
 
         if (const std::optional<Token> identifier{ tryConsume(TokenType::IDENTIFIER) }) {
-            const NodeTermIdentifier *const identifierTerm{ mAllocator.emplace<NodeTermIdentifier>(*identifier) };
+            const NodeTermIdentifier *const identifierTerm{ mAllocator.emplace<NodeTermIdentifier>(identifierOf(*identifier)) };
             const NodeTerm *const term{ mAllocator.emplace<NodeTerm>(identifierTerm) };
 
             return term;
@@ -250,7 +297,7 @@ public:
             }
             forceConsume(TokenType::SEMI);
 
-            const NodeStmtLet *const letStmt{ mAllocator.emplace<NodeStmtLet>(*identifier, expr) };
+            const NodeStmtLet *const letStmt{ mAllocator.emplace<NodeStmtLet>(identifierOf(*identifier), expr) };
             const NodeStmt *const stmt{ mAllocator.emplace<NodeStmt>(letStmt) };
 
             return stmt;
@@ -265,7 +312,7 @@ public:
                 errorExpected("expression");
             }
             forceConsume(TokenType::SEMI);
-            const NodeStmtAssign *const assignStmt{ mAllocator.emplace<NodeStmtAssign>(*identifier, expr) };
+            const NodeStmtAssign *const assignStmt{ mAllocator.emplace<NodeStmtAssign>(identifierOf(*identifier), expr) };
             const NodeStmt *const stmt{ mAllocator.emplace<NodeStmt>(assignStmt) };
 
             return stmt;
@@ -324,6 +371,27 @@ public:
             return stmt;
         }
 
+        if (tryConsume(TokenType::WHILE)) {
+            forceConsume(TokenType::OPEN_PAREN);
+
+            const NodeExpr *const expr{ parseExpr() };
+            if (!expr) {
+                errorExpected("expression");
+            }
+
+            forceConsume(TokenType::CLOSE_PAREN);
+
+            const NodeScope *const scope{ parseScope() };
+            if (!scope) {
+                errorExpected("scope");
+            }
+
+            const NodeStmtWhile *const whileStmt{ mAllocator.emplace<NodeStmtWhile>(expr, scope) };
+            const NodeStmt *const stmt{ mAllocator.emplace<NodeStmt>(whileStmt) };
+
+            return stmt;
+        }
+
         if (peek() && peek()->type == TokenType::OPEN_CURLY) {
             const NodeScope *const scope{ parseScope() };
             if (!scope) {
@@ -352,7 +420,16 @@ public:
         return prog;
     }
 
+    // Memory of the tree
+    [[nodiscard]] ArenaStats arenaStats() const {
+        return mAllocator.stats();
+    }
+
 private:
+    [[nodiscard]] Identifier identifierOf(const Token &identifier) const {
+        return { .name = mTextStream.text(identifier), .ln = identifier.ln };
+    }
+
     void errorExpected(const std::string &msg) {
         const int line = peek() ? peek()->ln : peek(-1)->ln;
         error("[Parse Error] Expected " + msg + " at line " + std::to_string(line));
@@ -375,5 +452,13 @@ private:
         return {}; // unreachable
     }
 
-    ArenaAllocator mAllocator{ FOUR_MEGABYTES };
+    using TextReader<Tokens>::peek;
+    using TextReader<Tokens>::consume;
+    using TextReader<Tokens>::mTextStream;
+    using TextReader<Tokens>::mIndex;
+
+    ArenaAllocator mAllocator{};
 };
+
+using Parser = BasicParser<TokenStream>;
+using StreamingParser = BasicParser<TokenPipe>;
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "block_layout.h"
+#include "copy_propagation.h"
+#include "error.h"
+#include "ir.h"
+#include "ir_dead_code.h"
+#include "jump_threading.h"
+#include "loop_invariant_code_motion.h"
+#include "loop_rotation.h"
+#include "loop_unrolling.h"
+#include "ssa.h"
+#include "strength_reduction.h"
+#include "value_numbering.h"
+
+// Form of the IR a pass works on
+enum class IrForm {
+    ANY,
+    SSA,
+    NORMAL, // no phis
+};
+
+struct PassTiming {
+    std::string name{};
+    double milliseconds{};
+};
+
+// Runs IR passes in the configured order, converting into and out of SSA form as the passes
+// require, and times each of them. The function always comes out of SSA form at the end.
+class PassManager {
+public:
+    PassManager(const PassManager &) = delete;
+    PassManager &operator=(const PassManager &) = delete;
+
+    PassManager() : mPipeline{ DEFAULT_PIPELINE } {}
+
+    static inline const std::vector<std::string> DEFAULT_PIPELINE{
+        "copy-prop", "strength", "cse", "licm", "dce", "rotate", "unroll", "thread-jumps", "layout",
+    };
+
+    void setPipeline(const std::vector<std::string> &names) {
+        for (const std::string &name : names) {
+            if (!findPass(name)) {
+                error("Unknown pass: " + name);
+            }
+        }
+        mPipeline = names;
+    }
+
+    void run(IrFunction &fn) {
+        mTimings.clear();
+        for (const std::string &name : mPipeline) {
+            const Pass &pass{ *findPass(name) };
+            if (pass.form == IrForm::SSA && !fn.ssa) {
+                timed("ssa", [](IrFunction &f) { SsaBuilder{}.run(f); }, fn);
+            } else if (pass.form == IrForm::NORMAL && fn.ssa) {
+                timed("out-of-ssa", [](IrFunction &f) { SsaDestructor{}.run(f); }, fn);
+            }
+            if (pass.run) {
+                timed(pass.name, pass.run, fn);
+            }
+        }
+        if (fn.ssa) {
+            timed("out-of-ssa", [](IrFunction &f) { SsaDestructor{}.run(f); }, fn);
+        }
+    }
+
+    [[nodiscard]] const std::vector<PassTiming> &timings() const {
+        return mTimings;
+    }
+
+private:
+    struct Pass {
+        std::string name{};
+        IrForm form{};
+        std::function<void(IrFunction &)> run{}; // nothing for the passes that only change the form
+    };
+
+    const Pass *findPass(const std::string &name) const {
+        for (const Pass &pass : mPasses) {
+            if (pass.name == name) {
+                return &pass;
+            }
+        }
+        return nullptr;
+    }
+
+    void timed(const std::string &name, const std::function<void(IrFunction &)> &run, IrFunction &fn) {
+        const auto start{ std::chrono::steady_clock::now() };
+        run(fn);
+        const std::chrono::duration<double, std::milli> elapsed{ std::chrono::steady_clock::now() - start };
+        mTimings.push_back({ .name = name, .milliseconds = elapsed.count() });
+    }
+
+    const std::vector<Pass> mPasses{
+        { .name = "ssa", .form = IrForm::SSA },
+        { .name = "out-of-ssa", .form = IrForm::NORMAL },
+        { .name = "copy-prop", .form = IrForm::SSA, .run = [](IrFunction &fn) { CopyPropagation{}.run(fn); } },
+        { .name = "cse", .form = IrForm::SSA, .run = [](IrFunction &fn) { ValueNumbering{}.run(fn); } },
+        { .name = "licm", .form = IrForm::SSA, .run = [](IrFunction &fn) { LoopInvariantCodeMotion{}.run(fn); } },
+        { .name = "strength", .form = IrForm::ANY, .run = [](IrFunction &fn) { StrengthReduction{}.run(fn); } },
+        { .name = "dce", .form = IrForm::SSA, .run = [](IrFunction &fn) { IrDeadCode{}.run(fn); } },
+        { .name = "rotate", .form = IrForm::NORMAL, .run = [](IrFunction &fn) { LoopRotation{}.run(fn); } },
+        { .name = "unroll", .form = IrForm::NORMAL, .run = [](IrFunction &fn) { LoopUnrolling{}.run(fn); } },
+        { .name = "thread-jumps", .form = IrForm::NORMAL, .run = [](IrFunction &fn) { JumpThreading{}.run(fn); } },
+        { .name = "layout", .form = IrForm::NORMAL, .run = [](IrFunction &fn) { BlockLayout{}.run(fn); } },
+    };
+    std::vector<std::string> mPipeline{};
+    std::vector<PassTiming> mTimings{};
+};
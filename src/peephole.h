@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cstdlib> // size_t
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility> // std::move
+#include <vector>
+
+#include "error.h"
+#include "x86.h"
+
+// Rewrites a window of consecutive instructions (comments and line markers don't count), or declines
+// with nothing. `next` is the index right after the window, for looking ahead.
+using PeepholeRewrite = std::optional<InstrList> (*)(
+    const InstrList &instrs,
+    const std::vector<size_t> &window,
+    size_t next
+);
+
+struct PeepholeRule {
+    std::string name{};
+    size_t windowSize{};
+    PeepholeRewrite rewrite{};
+    bool enabled{ true };
+    size_t hits{};
+};
+
+// Window-based peephole optimizer over the generated instruction list. Rules are applied
+// in order at each position and the list is rescanned until nothing changes.
+class PeepholeOptimizer {
+public:
+    PeepholeOptimizer(const PeepholeOptimizer &) = delete;
+    PeepholeOptimizer &operator=(const PeepholeOptimizer &) = delete;
+
+    PeepholeOptimizer() : mRules{
+        { .name = "push-pop", .windowSize = 2, .rewrite = pushPop },
+        { .name = "zero-adjust", .windowSize = 1, .rewrite = zeroAdjust },
+        { .name = "self-move", .windowSize = 1, .rewrite = selfMove },
+        { .name = "jump-next", .windowSize = 2, .rewrite = jumpNext },
+        { .name = "move-forward", .windowSize = 2, .rewrite = moveForward },
+    } {}
+
+    // Enables only the named rules
+    void select(const std::vector<std::string> &names) {
+        for (PeepholeRule &rule : mRules) {
+            rule.enabled = false;
+        }
+        for (const std::string &name : names) {
+            bool found{};
+            for (PeepholeRule &rule : mRules) {
+                if (rule.name == name) {
+                    rule.enabled = true;
+                    found = true;
+                }
+            }
+            if (!found) {
+                error("Unknown peephole rule: " + name);
+            }
+        }
+    }
+
+    void run(InstrList &instrs) {
+        for (bool changed{ true }; changed; ) {
+            changed = false;
+            InstrList out{};
+            out.reserve(instrs.size());
+
+            for (size_t i{ 0 }; i < instrs.size(); ) {
+                if (isAnnotation(instrs[i])) {
+                    out.push_back(std::move(instrs[i++]));
+                    continue;
+                }
+
+                std::optional<InstrList> replacement{};
+                std::vector<size_t> window{};
+                for (PeepholeRule &rule : mRules) {
+                    if (!rule.enabled) {
+                        continue;
+                    }
+                    window = collectWindow(instrs, i, rule.windowSize);
+                    if (window.size() == rule.windowSize) {
+                        replacement = rule.rewrite(instrs, window, window.back() + 1);
+                    }
+                    if (replacement) {
+                        ++rule.hits;
+                        break;
+                    }
+                }
+
+                if (!replacement) {
+                    out.push_back(std::move(instrs[i++]));
+                    continue;
+                }
+
+                for (size_t j{ i }; j <= window.back(); ++j) { // keep the annotations inside the window
+                    if (isAnnotation(instrs[j])) {
+                        out.push_back(std::move(instrs[j]));
+                    }
+                }
+                for (Instr &instr : *replacement) {
+                    out.push_back(std::move(instr));
+                }
+                i = window.back() + 1;
+                changed = true;
+            }
+
+            instrs = std::move(out);
+        }
+    }
+
+    [[nodiscard]] const std::vector<PeepholeRule> &rules() const {
+        return mRules;
+    }
+
+private:
+    static std::vector<size_t> collectWindow(const InstrList &instrs, size_t i, const size_t size) {
+        std::vector<size_t> window{};
+        for (; i < instrs.size() && window.size() < size; ++i) {
+            if (!isAnnotation(instrs[i])) {
+                window.push_back(i);
+            }
+        }
+        return window;
+    }
+
+    static bool isAnnotation(const Instr &instr) {
+        return instr.op == Op::COMMENT || instr.op == Op::LINE;
+    }
+
+    static bool mentions(const Operand &operand, const Reg reg) {
+        return operand.mentions(reg);
+    }
+
+    static bool fitsInt32(const Operand &operand) {
+        return operand.kind != Operand::Kind::IMM || (
+            operand.imm >= std::numeric_limits<int32_t>::min() &&
+            operand.imm <= std::numeric_limits<int32_t>::max()
+        );
+    }
+
+    // Whether `reg` is overwritten before being read from `from` on. Unknown control flow
+    // (labels and jumps) counts as a read.
+    static bool isDeadAfter(const InstrList &instrs, const size_t from, const Reg reg) {
+        for (size_t i{ from }; i < instrs.size(); ++i) {
+            const Instr &instr{ instrs[i] };
+            switch (instr.op) {
+            case Op::COMMENT:
+            case Op::LINE:
+                continue;
+            case Op::LABEL:
+            case Op::JMP:
+            case Op::JZ:
+            case Op::JNZ:
+            case Op::RET:
+                return false;
+            case Op::SYSCALL: // reads the number and the arguments, clobbers rcx and r11
+                return reg == Reg::RCX || reg == Reg::R11;
+            case Op::MUL:
+            case Op::DIV:
+                if (reg == Reg::RAX || (instr.op == Op::DIV && reg == Reg::RDX) || mentions(instr.dst, reg)) {
+                    return false;
+                }
+                if (reg == Reg::RDX) {
+                    return true;
+                }
+                continue;
+            case Op::MOV:
+            case Op::LEA:
+            case Op::POP:
+                if (mentions(instr.src, reg) || (instr.dst.kind == Operand::Kind::MEM && mentions(instr.dst, reg))) {
+                    return false;
+                }
+                if (instr.dst.isReg(reg)) {
+                    return true;
+                }
+                continue;
+            default: // reads both operands
+                if (mentions(instr.dst, reg) || mentions(instr.src, reg)) {
+                    return false;
+                }
+                continue;
+            }
+        }
+
+        return true;
+    }
+
+    // push X; pop Y  ->  mov Y, X
+    static std::optional<InstrList> pushPop(const InstrList &instrs, const std::vector<size_t> &window, size_t) {
+        const Instr &push{ instrs[window[0]] };
+        const Instr &pop{ instrs[window[1]] };
+        if (push.op != Op::PUSH || pop.op != Op::POP || pop.dst.kind != Operand::Kind::REG) {
+            return {};
+        }
+        if (push.dst == pop.dst) {
+            return InstrList{};
+        }
+        return InstrList{ { .op = Op::MOV, .dst = pop.dst, .src = push.dst } };
+    }
+
+    // add/sub X, 0  ->  nothing, unless a conditional jump reads its flags
+    static std::optional<InstrList> zeroAdjust(const InstrList &instrs, const std::vector<size_t> &window, const size_t next) {
+        const Instr &instr{ instrs[window[0]] };
+        if ((instr.op != Op::ADD && instr.op != Op::SUB) || instr.src.kind != Operand::Kind::IMM || instr.src.imm != 0) {
+            return {};
+        }
+        const std::vector<size_t> following{ collectWindow(instrs, next, 1) };
+        if (!following.empty() && (instrs[following[0]].op == Op::JZ || instrs[following[0]].op == Op::JNZ)) {
+            return {};
+        }
+        return InstrList{};
+    }
+
+    // mov X, X  ->  nothing
+    static std::optional<InstrList> selfMove(const InstrList &instrs, const std::vector<size_t> &window, size_t) {
+        const Instr &instr{ instrs[window[0]] };
+        if (instr.op == Op::MOV && instr.dst.kind == Operand::Kind::REG && instr.dst == instr.src) {
+            return InstrList{};
+        }
+        return {};
+    }
+
+    // jmp L; L:  ->  L:
+    static std::optional<InstrList> jumpNext(const InstrList &instrs, const std::vector<size_t> &window, size_t) {
+        const Instr &jump{ instrs[window[0]] };
+        const Instr &label{ instrs[window[1]] };
+        if (jump.op == Op::JMP && label.op == Op::LABEL && jump.dst.label == label.dst.label) {
+            return InstrList{ label };
+        }
+        return {};
+    }
+
+    // mov A, X; op B, A  ->  op B, X  when A is dead afterwards
+    static std::optional<InstrList> moveForward(const InstrList &instrs, const std::vector<size_t> &window, const size_t next) {
+        const Instr &move{ instrs[window[0]] };
+        const Instr &use{ instrs[window[1]] };
+        if (move.op != Op::MOV || move.dst.kind != Operand::Kind::REG || move.dst.isReg(Reg::RSP)) {
+            return {};
+        }
+        const Reg temp{ move.dst.reg };
+        const Operand &value{ move.src };
+
+        Instr rewritten{ use };
+        switch (use.op) {
+        case Op::MOV:
+        case Op::ADD:
+        case Op::SUB:
+        case Op::XOR:
+        case Op::IMUL:
+            if (!use.src.isReg(temp) || mentions(use.dst, temp) || !fitsInt32(value)) {
+                return {};
+            }
+            if (use.dst.kind == Operand::Kind::MEM && value.kind == Operand::Kind::MEM) {
+                return {};
+            }
+            if (use.op != Op::MOV && use.dst.kind != Operand::Kind::REG && value.kind == Operand::Kind::MEM) {
+                return {};
+            }
+            if (use.op == Op::IMUL && value.kind == Operand::Kind::IMM) { // no two-operand imul with an immediate
+                return {};
+            }
+            rewritten.src = value;
+            break;
+        case Op::DIV:
+            if (!use.dst.isReg(temp) || value.kind == Operand::Kind::IMM || mentions(value, Reg::RAX) || mentions(value, Reg::RDX)) {
+                return {};
+            }
+            rewritten.dst = value;
+            break;
+        default:
+            return {};
+        }
+
+        if (!isDeadAfter(instrs, next, temp)) {
+            return {};
+        }
+        return InstrList{ rewritten };
+    }
+
+    std::vector<PeepholeRule> mRules{};
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t
+#include <cstring> // std::memcpy
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "error.h"
+#include "ir.h"
+
+// Profile-guided optimization works on the blocks of the IR as the builder made them, which
+// are the same for a program whenever it's compiled with the same AST optimizations. An
+// instrumented build gives each of those blocks a counter bumped on entry, so every branch
+// of an `if`, every loop body and every scope gets counted, and the program writes the
+// counters to the profile file when it exits: one 64-bit little-endian count per block. A
+// later build reads them back as the blocks' counts before running the IR passes.
+
+// Gives every block a counter with its own number
+inline void instrument(IrFunction &fn) {
+    for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+        fn.blocks[b].counters = { b };
+    }
+    fn.counterCount = fn.blocks.size();
+}
+
+// Sets the block counts from the contents of a profile file
+inline void applyProfile(IrFunction &fn, const std::string_view profile) {
+    if (profile.size() != fn.blocks.size() * sizeof(uint64_t)) {
+        error("Profile doesn't match the program");
+    }
+    for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+        std::memcpy(&fn.blocks[b].count, profile.data() + b * sizeof(uint64_t), sizeof(uint64_t));
+    }
+    fn.profiled = true;
+}
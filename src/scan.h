@@ -0,0 +1,243 @@
+#pragma once
+
+#include <bit> // std::countr_zero, std::popcount
+#include <cstdint> // uint32_t
+#include <cstdlib> // size_t
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Character classes of the tokenizer, as in the "C" locale
+constexpr bool isSpace(const char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+constexpr bool isDigit(const char c) {
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool isAlpha(const char c) {
+    return (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+}
+
+constexpr bool isAlnum(const char c) {
+    return isAlpha(c) || isDigit(c);
+}
+
+// Scanners for the runs the tokenizer skips over. Each returns the index of the first byte
+// at or after `index` that ends the run, or `size`; `skipSpace` also counts the newlines it
+// passes. The vector versions look at 16 or 32 bytes at once and finish the tail of the
+// input with the scalar loop, so they never read past `size`.
+struct ScanKernels {
+    const char *name{};
+    size_t (*skipSpace)(const char *data, size_t index, size_t size, int &lines){};
+    size_t (*skipAlnum)(const char *data, size_t index, size_t size){};
+    size_t (*skipDigits)(const char *data, size_t index, size_t size){};
+    size_t (*findNewline)(const char *data, size_t index, size_t size){};
+};
+
+namespace scalar {
+
+inline size_t skipSpace(const char *const data, size_t index, const size_t size, int &lines) {
+    for (; index < size && isSpace(data[index]); ++index) {
+        lines += data[index] == '\n';
+    }
+    return index;
+}
+
+inline size_t skipAlnum(const char *const data, size_t index, const size_t size) {
+    while (index < size && isAlnum(data[index])) {
+        ++index;
+    }
+    return index;
+}
+
+inline size_t skipDigits(const char *const data, size_t index, const size_t size) {
+    while (index < size && isDigit(data[index])) {
+        ++index;
+    }
+    return index;
+}
+
+inline size_t findNewline(const char *const data, size_t index, const size_t size) {
+    while (index < size && data[index] != '\n') {
+        ++index;
+    }
+    return index;
+}
+
+} // namespace scalar
+
+constexpr ScanKernels SCALAR_KERNELS{
+    "scalar", scalar::skipSpace, scalar::skipAlnum, scalar::skipDigits, scalar::findNewline,
+};
+
+#if defined(__x86_64__)
+
+// SSE2 is part of x86-64, so these need no check. Signed byte compares are enough for the
+// ranges: bytes from 0x80 up compare as negative and fall outside all of them.
+namespace sse2 {
+
+constexpr size_t WIDTH{ 16 };
+
+inline __m128i inRange(const __m128i c, const char lo, const char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(static_cast<char>(lo - 1))), _mm_cmplt_epi8(c, _mm_set1_epi8(static_cast<char>(hi + 1))));
+}
+
+inline __m128i digits(const __m128i c) {
+    return inRange(c, '0', '9');
+}
+
+inline __m128i alnums(const __m128i c) {
+    return _mm_or_si128(inRange(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z'), digits(c));
+}
+
+// Bits of the bytes outside the class
+inline uint32_t outside(const __m128i inClass) {
+    return ~static_cast<uint32_t>(_mm_movemask_epi8(inClass)) & 0xFFFF;
+}
+
+inline size_t skipSpace(const char *const data, size_t index, const size_t size, int &lines) {
+    for (; index + WIDTH <= size; index += WIDTH) {
+        const __m128i c{ _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + index)) };
+        const __m128i spaces{ _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), inRange(c, '\t', '\r')) };
+        const uint32_t newlines{ static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')))) };
+        if (const uint32_t end{ outside(spaces) }) {
+            const int run{ std::countr_zero(end) };
+            lines += std::popcount(newlines & ((1u << run) - 1));
+            return index + run;
+        }
+        lines += std::popcount(newlines);
+    }
+    return scalar::skipSpace(data, index, size, lines);
+}
+
+inline size_t skipAlnum(const char *const data, size_t index, const size_t size) {
+    for (; index + WIDTH <= size; index += WIDTH) {
+        const __m128i c{ _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + index)) };
+        if (const uint32_t end{ outside(alnums(c)) }) {
+            return index + std::countr_zero(end);
+        }
+    }
+    return scalar::skipAlnum(data, index, size);
+}
+
+inline size_t skipDigits(const char *const data, size_t index, const size_t size) {
+    for (; index + WIDTH <= size; index += WIDTH) {
+        const __m128i c{ _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + index)) };
+        if (const uint32_t end{ outside(digits(c)) }) {
+            return index + std::countr_zero(end);
+        }
+    }
+    return scalar::skipDigits(data, index, size);
+}
+
+inline size_t findNewline(const char *const data, size_t index, const size_t size) {
+    for (; index + WIDTH <= size; index += WIDTH) {
+        const __m128i c{ _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + index)) };
+        if (const uint32_t newlines{ static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')))) }) {
+            return index + std::countr_zero(newlines);
+        }
+    }
+    return scalar::findNewline(data, index, size);
+}
+
+} // namespace sse2
+
+// The same scans 32 bytes at a time, compiled for AVX2 without enabling it for the rest of
+// the program
+namespace avx2 {
+
+constexpr size_t WIDTH{ 32 };
+
+[[gnu::target("avx2")]] inline __m256i inRange(const __m256i c, const char lo, const char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(static_cast<char>(lo - 1))), _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), c));
+}
+
+[[gnu::target("avx2")]] inline __m256i digits(const __m256i c) {
+    return inRange(c, '0', '9');
+}
+
+[[gnu::target("avx2")]] inline __m256i alnums(const __m256i c) {
+    return _mm256_or_si256(inRange(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z'), digits(c));
+}
+
+[[gnu::target("avx2")]] inline uint32_t outside(const __m256i inClass) {
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(inClass));
+}
+
+[[gnu::target("avx2")]] inline size_t skipSpace(const char *const data, size_t index, const size_t size, int &lines) {
+    for (; index + WIDTH <= size; index += WIDTH) {
+        const __m256i c{ _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + index)) };
+        const __m256i spaces{ _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), inRange(c, '\t', '\r')) };
+        const uint32_t newlines{ static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')))) };
+        if (const uint32_t end{ outside(spaces) }) {
+            const int run{ std::countr_zero(end) };
+            lines += std::popcount(newlines & ((1u << run) - 1));
+            return index + run;
+        }
+        lines += std::popcount(newlines);
+    }
+    return scalar::skipSpace(data, index, size, lines);
+}
+
+[[gnu::target("avx2")]] inline size_t skipAlnum(const char *const data, size_t index, const size_t size) {
+    for (; index + WIDTH <= size; index += WIDTH) {
+        const __m256i c{ _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + index)) };
+        if (const uint32_t end{ outside(alnums(c)) }) {
+            return index + std::countr_zero(end);
+        }
+    }
+    return scalar::skipAlnum(data, index, size);
+}
+
+[[gnu::target("avx2")]] inline size_t skipDigits(const char *const data, size_t index, const size_t size) {
+    for (; index + WIDTH <= size; index += WIDTH) {
+        const __m256i c{ _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + index)) };
+        if (const uint32_t end{ outside(digits(c)) }) {
+            return index + std::countr_zero(end);
+        }
+    }
+    return scalar::skipDigits(data, index, size);
+}
+
+[[gnu::target("avx2")]] inline size_t findNewline(const char *const data, size_t index, const size_t size) {
+    for (; index + WIDTH <= size; index += WIDTH) {
+        const __m256i c{ _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + index)) };
+        if (const uint32_t newlines{ static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')))) }) {
+            return index + std::countr_zero(newlines);
+        }
+    }
+    return scalar::findNewline(data, index, size);
+}
+
+} // namespace avx2
+
+constexpr ScanKernels SSE2_KERNELS{
+    "sse2", sse2::skipSpace, sse2::skipAlnum, sse2::skipDigits, sse2::findNewline,
+};
+
+constexpr ScanKernels AVX2_KERNELS{
+    "avx2", avx2::skipSpace, avx2::skipAlnum, avx2::skipDigits, avx2::findNewline,
+};
+
+#endif
+
+// The kernels this CPU can run, slowest first
+inline std::vector<const ScanKernels *> supportedKernels() {
+    std::vector<const ScanKernels *> kernels{ &SCALAR_KERNELS };
+#if defined(__x86_64__)
+    kernels.push_back(&SSE2_KERNELS);
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back(&AVX2_KERNELS);
+    }
+#endif
+    return kernels;
+}
+
+inline const ScanKernels &bestKernels() {
+    static const ScanKernels *const best{ supportedKernels().back() };
+    return *best;
+}
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm> // std::min
+#include <cstddef> // std::ptrdiff_t
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t
+#include <utility> // std::move, std::pair
+#include <vector>
+
+#include "ir.h"
+#include "ir_dominators.h"
+#include "ir_liveness.h"
+
+// Puts the function into pruned SSA form (Cytron et al.): phis go to the iterated dominance
+// frontier of a register's definitions, wherever the register is live, and every definition
+// then gets a fresh register while walking the dominator tree.
+class SsaBuilder {
+public:
+    SsaBuilder(const SsaBuilder &) = delete;
+    SsaBuilder &operator=(const SsaBuilder &) = delete;
+
+    SsaBuilder() = default;
+
+    void run(IrFunction &fn) {
+        if (fn.ssa) {
+            return;
+        }
+        removeUnreachableBlocks(fn);
+
+        IrLiveness liveness{};
+        const IrLiveSets live{ liveness.analyze(fn) };
+        Dominators dominators{};
+        const DomTree tree{ dominators.analyze(fn) };
+
+        // registers defined more than once need renaming
+        const Vreg originalCount{ fn.vregCount };
+        std::vector<std::vector<size_t>> defBlocks(originalCount);
+        std::vector<bool> renamed(originalCount);
+        for (size_t b{ 0 }; b < fn.blocks.size(); ++b) {
+            for (const IrInstr &instr : fn.blocks[b].instrs) {
+                std::vector<size_t> &blocks{ defBlocks[instr.dst] };
+                if (!blocks.empty()) {
+                    renamed[instr.dst] = true;
+                }
+                if (blocks.empty() || blocks.back() != b) {
+                    blocks.push_back(b);
+                }
+            }
+        }
+
+        // phi placement
+        std::vector<std::vector<Vreg>> phiVars(fn.blocks.size()); // original register of each phi
+        std::vector<Vreg> hasPhi(fn.blocks.size(), NO_VREG);
+        std::vector<Vreg> queued(fn.blocks.size(), NO_VREG);
+        for (Vreg vreg{ 0 }; vreg < originalCount; ++vreg) {
+            if (!renamed[vreg]) {
+                continue;
+            }
+            std::vector<size_t> worklist{ defBlocks[vreg] };
+            for (const size_t block : worklist) {
+                queued[block] = vreg;
+            }
+            while (!worklist.empty()) {
+                const size_t block{ worklist.back() };
+                worklist.pop_back();
+                for (const size_t join : tree.frontier[block]) {
+                    if (hasPhi[join] == vreg || !live.liveIn(join, vreg)) {
+                        continue;
+                    }
+                    hasPhi[join] = vreg;
+                    IrBlock &joinBlock{ fn.blocks[join] };
+                    const size_t predCount{ joinBlock.preds.size() };
+                    joinBlock.phis.push_back({ .dst = vreg, .args = std::vector<IrOperand>(predCount), .lines = std::vector<int>(predCount) });
+                    phiVars[join].push_back(vreg);
+                    if (queued[join] != vreg) {
+                        queued[join] = vreg;
+                        worklist.push_back(join);
+                    }
+                }
+            }
+        }
+
+        rename(fn, tree, renamed, phiVars);
+        fn.ssa = true;
+    }
+
+private:
+    static constexpr Vreg NO_VREG{ static_cast<Vreg>(-1) };
+
+    // Walks the dominator tree with a stack of current names per renamed register
+    static void rename(
+        IrFunction &fn,
+        const DomTree &tree,
+        const std::vector<bool> &renamed,
+        const std::vector<std::vector<Vreg>> &phiVars
+    ) {
+        std::vector<std::vector<Vreg>> names(renamed.size());
+        std::vector<std::vector<Vreg>> pushed(fn.blocks.size()); // to pop when leaving a block
+
+        // source line of each register's definition, 0 for phis
+        std::vector<int> defLines(fn.vregCount);
+        for (const IrBlock &block : fn.blocks) {
+            for (const IrInstr &instr : block.instrs) {
+                if (!renamed[instr.dst]) {
+                    defLines[instr.dst] = instr.line;
+                }
+            }
+        }
+
+        const auto current{ [&](const IrOperand &operand) {
+            if (!operand.isVreg() || !renamed[operand.vreg()] || names[operand.vreg()].empty()) {
+                return operand;
+            }
+            return IrOperand::v(names[operand.vreg()].back());
+        } };
+        const auto define{ [&](const size_t block, const Vreg vreg, const int line) {
+            const Vreg name{ fn.newVreg() };
+            names[vreg].push_back(name);
+            pushed[block].push_back(vreg);
+            defLines.push_back(line);
+            return name;
+        } };
+
+        std::vector<std::pair<size_t, bool>> stack{ { 0, false } }; // block, leaving
+        while (!stack.empty()) {
+            const auto [b, leaving]{ stack.back() };
+            stack.pop_back();
+            if (leaving) {
+                for (const Vreg vreg : pushed[b]) {
+                    names[vreg].pop_back();
+                }
+                continue;
+            }
+
+            IrBlock &block{ fn.blocks[b] };
+            for (size_t i{ 0 }; i < block.phis.size(); ++i) {
+                block.phis[i].dst = define(b, phiVars[b][i], 0);
+            }
+            for (IrInstr &instr : block.instrs) {
+                instr.a = current(instr.a);
+                instr.b = current(instr.b);
+                if (renamed[instr.dst]) {
+                    instr.dst = define(b, instr.dst, instr.line);
+                }
+            }
+            block.term.value = current(block.term.value);
+
+            for (const size_t succ : successors(block)) {
+                IrBlock &succBlock{ fn.blocks[succ] };
+                for (size_t j{ 0 }; j < succBlock.preds.size(); ++j) {
+                    if (succBlock.preds[j] != b) {
+                        continue;
+                    }
+                    for (size_t i{ 0 }; i < succBlock.phis.size(); ++i) {
+                        const IrOperand arg{ current(IrOperand::v(phiVars[succ][i])) };
+                        succBlock.phis[i].args[j] = arg;
+                        succBlock.phis[i].lines[j] = defLines[arg.vreg()];
+                    }
+                }
+            }
+
+            stack.push_back({ b, true });
+            for (const size_t child : tree.children[b]) {
+                stack.push_back({ child, false });
+            }
+        }
+    }
+};
+
+// Leaves SSA form: phis become copies at the end of the predecessors. Edges out of blocks
+// with several successors are split first so the copies run only on their edge, and each
+// edge's copies are ordered as a parallel copy, breaking cycles with a temporary.
+class SsaDestructor {
+public:
+    SsaDestructor(const SsaDestructor &) = delete;
+    SsaDestructor &operator=(const SsaDestructor &) = delete;
+
+    SsaDestructor() = default;
+
+    void run(IrFunction &fn) {
+        if (!fn.ssa) {
+            return;
+        }
+
+        const size_t blockCount{ fn.blocks.size() };
+        for (size_t b{ 0 }; b < blockCount; ++b) {
+            if (fn.blocks[b].phis.empty()) {
+                continue;
+            }
+            for (size_t i{ 0 }; i < fn.blocks[b].preds.size(); ++i) {
+                const size_t pred{ fn.blocks[b].preds[i] };
+                if (successors(fn.blocks[pred]).size() > 1) {
+                    fn.blocks[b].preds[i] = splitEdge(fn, pred, b, i);
+                }
+            }
+
+            std::vector<Copy> copies{};
+            for (size_t i{ 0 }; i < fn.blocks[b].preds.size(); ++i) {
+                copies.clear();
+                for (const IrPhi &phi : fn.blocks[b].phis) {
+                    if (phi.args[i].kind != IrOperand::Kind::NONE) {
+                        copies.push_back({ .dst = phi.dst, .src = phi.args[i], .line = phi.lines[i] });
+                    }
+                }
+                sequentialize(fn, copies, fn.blocks[fn.blocks[b].preds[i]].instrs);
+            }
+            fn.blocks[b].phis.clear();
+        }
+
+        computePreds(fn);
+        fn.ssa = false;
+    }
+
+private:
+    // `dst = src`, on the line that defined the value
+    struct Copy {
+        Vreg dst{};
+        IrOperand src{};
+        int line{};
+    };
+
+    // New block on the `index`-th incoming edge of `block`, which comes from `pred`
+    static size_t splitEdge(IrFunction &fn, const size_t pred, const size_t block, const size_t index) {
+        const size_t split{ fn.blocks.size() };
+        const uint64_t count{ std::min(fn.blocks[pred].count, fn.blocks[block].count) }; // at most what both ends ran
+        fn.blocks.push_back({ .term = { .kind = IrTerm::Kind::JMP, .target = block }, .preds = { pred }, .count = count });
+
+        // the first edge from `pred` is its target, the second its else target
+        bool first{ true };
+        for (size_t i{ 0 }; i < index; ++i) {
+            first = first && fn.blocks[block].preds[i] != pred;
+        }
+        IrTerm &term{ fn.blocks[pred].term };
+        if (first && term.target == block) {
+            term.target = split;
+        } else {
+            term.elseTarget = split;
+        }
+        return split;
+    }
+
+    // Emits `dst = src` for all the copies as if they happened at once
+    static void sequentialize(IrFunction &fn, std::vector<Copy> &copies, std::vector<IrInstr> &out) {
+        std::erase_if(copies, [](const Copy &copy) { return copy.src == IrOperand::v(copy.dst); });
+
+        while (!copies.empty()) {
+            bool emitted{};
+            for (size_t i{ 0 }; i < copies.size(); ++i) {
+                const Vreg dst{ copies[i].dst };
+                bool blocked{};
+                for (const Copy &other : copies) {
+                    blocked = blocked || other.src == IrOperand::v(dst);
+                }
+                if (!blocked) {
+                    out.push_back({ .op = IrOp::COPY, .dst = dst, .a = copies[i].src, .line = copies[i].line });
+                    copies.erase(copies.begin() + static_cast<std::ptrdiff_t>(i));
+                    emitted = true;
+                    break;
+                }
+            }
+            if (emitted) {
+                continue;
+            }
+
+            // only cycles are left: save one destination and read it from the temporary
+            const Vreg saved{ copies.front().dst };
+            const Vreg temp{ fn.newVreg() };
+            out.push_back({ .op = IrOp::COPY, .dst = temp, .a = IrOperand::v(saved), .line = copies.front().line });
+            for (Copy &copy : copies) {
+                if (copy.src == IrOperand::v(saved)) {
+                    copy.src = IrOperand::v(temp);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <bit> // std::has_single_bit, std::countr_zero, std::bit_width
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t
+#include <utility> // std::move, std::swap
+#include <vector>
+
+#include "ir.h"
+
+// Multiply-by-reciprocal form of an unsigned 64-bit division by a constant that isn't a
+// power of two: with `q = mulhu(n, multiplier)` the quotient is `q >> shift`, or
+// `(((n - q) >> 1) + q) >> shift` when `add` is set because the exact multiplier needs
+// 65 bits (Granlund and Montgomery's round-up method)
+struct UnsignedMagic {
+    uint64_t multiplier{};
+    unsigned shift{};
+    bool add{};
+};
+
+inline UnsignedMagic unsignedMagic(const uint64_t divisor) {
+    const unsigned floorLog2{ static_cast<unsigned>(std::bit_width(divisor)) - 1 };
+    const unsigned __int128 dividend{ static_cast<unsigned __int128>(1) << (64 + floorLog2) };
+    uint64_t proposed{ static_cast<uint64_t>(dividend / divisor) };
+    const uint64_t rem{ static_cast<uint64_t>(dividend % divisor) };
+
+    if (divisor - rem < (uint64_t{ 1 } << floorLog2)) { // 2^(64 + floorLog2) / divisor rounded up is close enough
+        return { .multiplier = proposed + 1, .shift = floorLog2 };
+    }
+
+    // one more bit of precision: 2^(65 + floorLog2) / divisor, without its top bit
+    proposed += proposed;
+    const uint64_t twiceRem{ rem + rem };
+    if (twiceRem >= divisor || twiceRem < rem) {
+        ++proposed;
+    }
+    return { .multiplier = proposed + 1, .shift = floorLog2, .add = true };
+}
+
+// Replaces multiplications and divisions by constants with cheaper instructions: shifts for
+// powers of two, a shift and an add or subtract for constants next to one, and a
+// high multiply with shifts for the other divisors. Works in either form, as every
+// rewritten instruction still defines its register once, after reading its operands.
+class StrengthReduction {
+public:
+    StrengthReduction(const StrengthReduction &) = delete;
+    StrengthReduction &operator=(const StrengthReduction &) = delete;
+
+    StrengthReduction() = default;
+
+    void run(IrFunction &fn) {
+        for (IrBlock &block : fn.blocks) {
+            std::vector<IrInstr> instrs{};
+            instrs.reserve(block.instrs.size());
+            for (const IrInstr &instr : block.instrs) {
+                const size_t first{ instrs.size() };
+                if (instr.op == IrOp::MUL) {
+                    reduceMul(fn, instr, instrs);
+                } else if (instr.op == IrOp::DIV) {
+                    reduceDiv(fn, instr, instrs);
+                } else {
+                    instrs.push_back(instr);
+                }
+                for (size_t i{ first }; i < instrs.size(); ++i) { // the replacement keeps the line
+                    instrs[i].line = instr.line;
+                }
+            }
+            block.instrs = std::move(instrs);
+        }
+    }
+
+private:
+    static void reduceMul(IrFunction &fn, const IrInstr &instr, std::vector<IrInstr> &out) {
+        IrOperand x{ instr.a };
+        IrOperand c{ instr.b };
+        if (x.isImm()) { // commutative
+            std::swap(x, c);
+        }
+        if (!x.isVreg() || !c.isImm()) {
+            out.push_back(instr);
+            return;
+        }
+
+        const uint64_t value{ c.value };
+        const Vreg dst{ instr.dst };
+        if (value == 0) {
+            out.push_back({ .op = IrOp::COPY, .dst = dst, .a = IrOperand::i(0) });
+        } else if (value == 1) {
+            out.push_back({ .op = IrOp::COPY, .dst = dst, .a = x });
+        } else if (value == ~uint64_t{ 0 }) {
+            out.push_back({ .op = IrOp::SUB, .dst = dst, .a = IrOperand::i(0), .b = x });
+        } else if (std::has_single_bit(value)) {
+            out.push_back({ .op = IrOp::SHL, .dst = dst, .a = x, .b = IrOperand::i(std::countr_zero(value)) });
+        } else if (std::has_single_bit(value - 1)) { // 2^k + 1
+            const Vreg shifted{ fn.newVreg() };
+            out.push_back({ .op = IrOp::SHL, .dst = shifted, .a = x, .b = IrOperand::i(std::countr_zero(value - 1)) });
+            out.push_back({ .op = IrOp::ADD, .dst = dst, .a = IrOperand::v(shifted), .b = x });
+        } else if (std::has_single_bit(value + 1)) { // 2^k - 1
+            const Vreg shifted{ fn.newVreg() };
+            out.push_back({ .op = IrOp::SHL, .dst = shifted, .a = x, .b = IrOperand::i(std::countr_zero(value + 1)) });
+            out.push_back({ .op = IrOp::SUB, .dst = dst, .a = IrOperand::v(shifted), .b = x });
+        } else {
+            out.push_back({ .op = IrOp::MUL, .dst = dst, .a = x, .b = c });
+        }
+    }
+
+    static void reduceDiv(IrFunction &fn, const IrInstr &instr, std::vector<IrInstr> &out) {
+        const IrOperand &n{ instr.a };
+        if (!n.isVreg() || !instr.b.isImm() || instr.b.value == 0) { // division by zero still traps
+            out.push_back(instr);
+            return;
+        }
+
+        const uint64_t divisor{ instr.b.value };
+        const Vreg dst{ instr.dst };
+        if (divisor == 1) {
+            out.push_back({ .op = IrOp::COPY, .dst = dst, .a = n });
+            return;
+        }
+        if (std::has_single_bit(divisor)) {
+            out.push_back({ .op = IrOp::SHR, .dst = dst, .a = n, .b = IrOperand::i(std::countr_zero(divisor)) });
+            return;
+        }
+
+        const UnsignedMagic magic{ unsignedMagic(divisor) };
+        const Vreg high{ fn.newVreg() };
+        out.push_back({ .op = IrOp::MULHU, .dst = high, .a = n, .b = IrOperand::i(magic.multiplier) });
+        if (!magic.add) {
+            out.push_back({ .op = IrOp::SHR, .dst = dst, .a = IrOperand::v(high), .b = IrOperand::i(magic.shift) });
+            return;
+        }
+
+        // n - q can't overflow, and halving it keeps the sum with q within 64 bits
+        const Vreg diff{ fn.newVreg() };
+        const Vreg half{ fn.newVreg() };
+        const Vreg sum{ fn.newVreg() };
+        out.push_back({ .op = IrOp::SUB, .dst = diff, .a = n, .b = IrOperand::v(high) });
+        out.push_back({ .op = IrOp::SHR, .dst = half, .a = IrOperand::v(diff), .b = IrOperand::i(1) });
+        out.push_back({ .op = IrOp::ADD, .dst = sum, .a = IrOperand::v(half), .b = IrOperand::v(high) });
+        out.push_back({ .op = IrOp::SHR, .dst = dst, .a = IrOperand::v(sum), .b = IrOperand::i(magic.shift) });
+    }
+};
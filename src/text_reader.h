@@ -15,7 +15,7 @@ public:
 
 protected:
     [[nodiscard]] std::optional<typename TextStream::value_type> peek(const int offset = 0) const {
-        if (mIndex + offset >= mTextStream.size()) {
+        if (!available(mIndex + offset)) {
             return {};
         }
 
@@ -24,6 +24,15 @@ protected:
 
     TextStream::value_type consume() { return mTextStream[mIndex++]; }
 
+    // A stream that is still being produced knows only whether it reaches an index
+    [[nodiscard]] bool available(const size_t index) const {
+        if constexpr (requires { mTextStream.available(index); }) {
+            return mTextStream.available(index);
+        } else {
+            return index < mTextStream.size();
+        }
+    }
+
     const TextStream mTextStream;
     size_t mIndex{};
 };
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm> // std::min
+#include <condition_variable>
+#include <cstdlib> // size_t
+#include <deque>
+#include <memory> // std::unique_ptr
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility> // std::move
+#include <vector>
+
+#include "error.h"
+#include "scan.h"
+#include "tokenizer.h"
+
+// Tokens of a source delivered while a thread is still lexing it, so parsing overlaps lexing
+// and only a bounded window of tokens exists at once. The lexer cuts the source after
+// newlines into batches of about BATCH_SIZE bytes and works at most BATCH_COUNT batches
+// ahead of the reader; batches the reader is done with go back to the lexer for reuse. The
+// reader sees the current batch and the token before it, which is as far back as the
+// parser looks. A lexing error is reported when the reader gets to it, so errors come in
+// the order of the source.
+class TokenPipe {
+public:
+    using value_type = Token;
+
+    TokenPipe() = delete;
+    TokenPipe(const TokenPipe &) = delete;
+    TokenPipe &operator=(const TokenPipe &) = delete;
+    TokenPipe(TokenPipe &&) = default;
+
+    explicit TokenPipe(const std::string_view source) : mState{ std::make_unique<State>(source) } {
+        mState->lexer = std::jthread{ [state = mState.get()](const std::stop_token stop) { lex(stop, *state); } };
+    }
+
+    [[nodiscard]] bool available(const size_t index) const {
+        State &state{ *mState };
+        if (index + 1 == state.base) {
+            return state.base > 0; // the token before the batch
+        }
+        if (index < state.base) {
+            return false; // gone
+        }
+        while (index >= state.base + state.current.size()) {
+            if (!nextBatch(state)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] Token operator[](const size_t index) const {
+        if (!available(index)) {
+            error("Token " + std::to_string(index) + " is outside the pipe's window");
+        }
+        const State &state{ *mState };
+        if (index < state.base) {
+            return state.previous;
+        }
+        return state.current[index - state.base];
+    }
+
+    [[nodiscard]] std::string_view text(const Token &identifier) const {
+        return mState->current.text(identifier);
+    }
+
+private:
+    static constexpr size_t BATCH_SIZE{ 64 * 1024 }; // bytes of source
+    static constexpr size_t BATCH_COUNT{ 4 };
+
+    struct State {
+        explicit State(const std::string_view src) : source{ src }, current{ src } {}
+
+        std::string_view source{};
+        std::mutex mutex{};
+        std::condition_variable_any changed{};
+        std::deque<TokenStream> full{}; // lexed, in source order
+        std::vector<TokenStream> spare{}; // read, for the lexer to reuse
+        size_t batchCount{}; // made so far, at most BATCH_COUNT
+        bool done{};
+        std::optional<std::string> failure{};
+
+        TokenStream current; // the reader's batch
+        size_t base{}; // index of its first token
+        Token previous{};
+
+        std::jthread lexer{}; // last, so it stops before the rest goes
+    };
+
+    static void lex(const std::stop_token stop, State &state) {
+        Tokenizer tokenizer{ state.source };
+        const ScanKernels &kernels{ bestKernels() };
+        const size_t size{ state.source.size() };
+        int line{ 1 };
+        for (size_t begin{ 0 }; begin < size && !stop.stop_requested();) {
+            const size_t cut{ kernels.findNewline(state.source.data(), std::min(begin + BATCH_SIZE, size), size) };
+            const size_t end{ std::min(cut + 1, size) };
+
+            std::optional<TokenStream> batch{};
+            {
+                std::unique_lock lock{ state.mutex };
+                state.changed.wait(lock, stop, [&state] { return !state.spare.empty() || state.batchCount < BATCH_COUNT; });
+                if (stop.stop_requested()) {
+                    return;
+                }
+                if (state.spare.empty()) {
+                    batch.emplace(state.source);
+                    ++state.batchCount;
+                } else {
+                    batch.emplace(std::move(state.spare.back()));
+                    state.spare.pop_back();
+                }
+            }
+
+            batch->clear();
+            line += tokenizer.tokenize(begin, end, *batch, line);
+
+            const std::lock_guard lock{ state.mutex };
+            state.full.push_back(std::move(*batch));
+            state.failure = tokenizer.failure();
+            if (state.failure) {
+                break;
+            }
+            state.changed.notify_all();
+            begin = end;
+        }
+
+        const std::lock_guard lock{ state.mutex };
+        state.done = true;
+        state.changed.notify_all();
+    }
+
+    // Moves the reader to the next batch, giving the current one back
+    static bool nextBatch(State &state) {
+        std::unique_lock lock{ state.mutex };
+        state.changed.wait(lock, [&state] { return !state.full.empty() || state.done; });
+        if (state.full.empty()) {
+            if (state.failure) {
+                error(*state.failure);
+            }
+            return false;
+        }
+
+        if (state.current.size() > 0) {
+            state.previous = state.current[state.current.size() - 1];
+        }
+        state.base += state.current.size();
+        state.spare.push_back(std::move(state.current));
+        state.current = std::move(state.full.front());
+        state.full.pop_front();
+        state.changed.notify_all();
+        return true;
+    }
+
+    std::unique_ptr<State> mState{};
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <array>
+#include <cstdint> // uint8_t, uint32_t
+#include <cstdlib> // size_t
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "scan.h"
+
+enum class TokenType : uint8_t {
+    EXIT, INT_LITERAL, SEMI, OPEN_PAREN, CLOSE_PAREN, IDENTIFIER, LET, EQ,
+    PLUS, MINUS, STAR, FSLASH, OPEN_CURLY, CLOSE_CURLY, IF, ELIF, ELSE, WHILE,
+};
+
+// Every token once, in the order of `TokenType`. A token with a spelling is a keyword (letters)
+// or punctuation (one other character); the tokenizer's tables, `to_string` and `binPrec` are
+// all made from this list, so a new token only needs its line here.
+struct TokenSpec {
+    TokenType type{};
+    std::string_view spelling{}; // empty for tokens with a value
+    std::string_view description{}; // for tokens without a spelling
+    int prec{ -1 }; // binary operator precedence
+};
+
+constexpr TokenSpec TOKEN_SPECS[]{
+    { TokenType::EXIT, "exit" },
+    { TokenType::INT_LITERAL, {}, "int literal" },
+    { TokenType::SEMI, ";" },
+    { TokenType::OPEN_PAREN, "(" },
+    { TokenType::CLOSE_PAREN, ")" },
+    { TokenType::IDENTIFIER, {}, "identifier" },
+    { TokenType::LET, "let" },
+    { TokenType::EQ, "=" },
+    { TokenType::PLUS, "+", {}, 0 },
+    { TokenType::MINUS, "-", {}, 0 },
+    { TokenType::STAR, "*", {}, 1 },
+    { TokenType::FSLASH, "/", {}, 1 },
+    { TokenType::OPEN_CURLY, "{" },
+    { TokenType::CLOSE_CURLY, "}" },
+    { TokenType::IF, "if" },
+    { TokenType::ELIF, "elif" },
+    { TokenType::ELSE, "else" },
+    { TokenType::WHILE, "while" },
+};
+
+constexpr const TokenSpec &spec(const TokenType type) {
+    return TOKEN_SPECS[static_cast<size_t>(type)];
+}
+
+constexpr bool isKeyword(const TokenSpec &tokenSpec) {
+    return !tokenSpec.spelling.empty() && isAlpha(tokenSpec.spelling.front());
+}
+
+constexpr bool specsValid() {
+    for (size_t i{ 0 }; i < std::size(TOKEN_SPECS); ++i) {
+        const TokenSpec &tokenSpec{ TOKEN_SPECS[i] };
+        if (static_cast<size_t>(tokenSpec.type) != i || tokenSpec.spelling.empty() == tokenSpec.description.empty()) {
+            return false;
+        }
+        if (!tokenSpec.spelling.empty() && !isKeyword(tokenSpec) && tokenSpec.spelling.size() != 1) {
+            return false; // longer punctuation would need more states than the start one
+        }
+    }
+    return true;
+}
+static_assert(specsValid(), "TOKEN_SPECS must list every TokenType in order, with a spelling or a description");
+
+inline std::optional<int> binPrec(const TokenType &type) {
+    if (spec(type).prec < 0) {
+        return {};
+    }
+    return spec(type).prec;
+}
+
+inline std::string to_string(const TokenType &type) {
+    const TokenSpec &tokenSpec{ spec(type) };
+    if (tokenSpec.spelling.empty()) {
+        return std::string{ tokenSpec.description };
+    }
+    return "'" + std::string{ tokenSpec.spelling } + "'";
+}
+
+//===========================================================================
+// Start state of the lexer: what a byte begins. Runs of spaces, identifier characters, digits
+// and comment text are the other states, and the scan kernels walk those.
+enum class CharClass : uint8_t {
+    INVALID, SPACE, LETTER, DIGIT, COMMENT, PUNCTUATION,
+};
+
+struct CharTable {
+    std::array<CharClass, 256> classes{};
+    std::array<TokenType, 256> punctuation{};
+};
+
+constexpr CharTable makeCharTable() {
+    CharTable table{};
+    for (size_t b{ 0 }; b < table.classes.size(); ++b) {
+        const char c{ static_cast<char>(b) };
+        if (isSpace(c)) {
+            table.classes[b] = CharClass::SPACE;
+        } else if (isAlpha(c)) {
+            table.classes[b] = CharClass::LETTER;
+        } else if (isDigit(c)) {
+            table.classes[b] = CharClass::DIGIT;
+        } else if (c == '#') {
+            table.classes[b] = CharClass::COMMENT;
+        }
+    }
+    for (const TokenSpec &tokenSpec : TOKEN_SPECS) {
+        if (!tokenSpec.spelling.empty() && !isKeyword(tokenSpec)) {
+            const uint8_t b{ static_cast<uint8_t>(tokenSpec.spelling.front()) };
+            table.classes[b] = CharClass::PUNCTUATION;
+            table.punctuation[b] = tokenSpec.type;
+        }
+    }
+    return table;
+}
+
+constexpr CharTable CHAR_TABLE{ makeCharTable() };
+
+//===========================================================================
+// Perfect hash of the keywords on their length and first and last letters, with a multiplier
+// and a power-of-two table size searched for at compile time
+struct KeywordHash {
+    uint32_t multiplier{};
+    uint32_t mask{};
+};
+
+constexpr uint32_t hashWord(const std::string_view word, const KeywordHash hash) {
+    const uint32_t mixed{ static_cast<uint32_t>(word.size()) + static_cast<uint8_t>(word.front()) * hash.multiplier + static_cast<uint8_t>(word.back()) * 7 };
+    return (mixed ^ (mixed >> 5)) & hash.mask;
+}
+
+constexpr std::optional<KeywordHash> findKeywordHash() {
+    constexpr uint32_t MAX_MULTIPLIER{ 1024 };
+    constexpr uint32_t MAX_SIZE{ 256 };
+    for (uint32_t size{ 1 }; size <= MAX_SIZE; size *= 2) {
+        for (uint32_t multiplier{ 1 }; multiplier < MAX_MULTIPLIER; ++multiplier) {
+            const KeywordHash hash{ multiplier, size - 1 };
+            std::array<bool, MAX_SIZE> used{};
+            bool collides{};
+            for (const TokenSpec &tokenSpec : TOKEN_SPECS) {
+                if (isKeyword(tokenSpec)) {
+                    const uint32_t slot{ hashWord(tokenSpec.spelling, hash) };
+                    collides |= used[slot];
+                    used[slot] = true;
+                }
+            }
+            if (!collides) {
+                return hash;
+            }
+        }
+    }
+    return {};
+}
+
+constexpr std::optional<KeywordHash> FOUND_KEYWORD_HASH{ findKeywordHash() };
+static_assert(FOUND_KEYWORD_HASH, "no perfect hash for the keywords: hash more of their letters");
+constexpr KeywordHash KEYWORD_HASH{ *FOUND_KEYWORD_HASH };
+
+// Keyword in each slot of the hash, IDENTIFIER for empty slots
+constexpr std::array<TokenType, KEYWORD_HASH.mask + 1> makeKeywordSlots() {
+    std::array<TokenType, KEYWORD_HASH.mask + 1> slots{};
+    slots.fill(TokenType::IDENTIFIER);
+    for (const TokenSpec &tokenSpec : TOKEN_SPECS) {
+        if (isKeyword(tokenSpec)) {
+            slots[hashWord(tokenSpec.spelling, KEYWORD_HASH)] = tokenSpec.type;
+        }
+    }
+    return slots;
+}
+
+constexpr std::array<TokenType, KEYWORD_HASH.mask + 1> KEYWORD_SLOTS{ makeKeywordSlots() };
+
+// The keyword spelled `word`, or IDENTIFIER
+constexpr TokenType keywordType(const std::string_view word) {
+    const TokenType type{ KEYWORD_SLOTS[hashWord(word, KEYWORD_HASH)] };
+    return spec(type).spelling == word ? type : TokenType::IDENTIFIER;
+}
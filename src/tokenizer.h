@@ -1,165 +1,186 @@
 #pragma once
 
-#include <cctype> // std::isalpha, std::alnum, std::isspace
+#include <cstdint> // uint8_t, uint32_t, uint64_t
 #include <cstdlib> // size_t
+#include <limits> // std::numeric_limits
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "error.h"
+#include "scan.h"
 #include "text_reader.h"
+#include "token_spec.h"
 
-enum class TokenType {
-    EXIT, INT_LITERAL, SEMI, OPEN_PAREN, CLOSE_PAREN, IDENTIFIER, LET, EQ,
-    PLUS, MINUS, STAR, FSLASH, OPEN_CURLY, CLOSE_CURLY, IF, ELIF, ELSE,
+// Tokens don't own text: an identifier is a span of the source, which must outlive the tokens
+// and the tree built from them, and an int literal is parsed into its value once
+struct Token {
+    TokenType type{};
+    int ln{};
+    uint64_t value{}; // INT_LITERAL: the literal, IDENTIFIER: offset << 32 | length in the source
 };
+static_assert(sizeof(Token) <= 16);
+
+// Tokens stored as parallel arrays, so the parser's lookahead on types touches one byte a token
+class TokenStream {
+public:
+    using value_type = Token;
+
+    TokenStream(const TokenStream &) = delete;
+    TokenStream &operator=(const TokenStream &) = delete;
+    TokenStream(TokenStream &&) = default;
+    TokenStream &operator=(TokenStream &&) = default;
+
+    explicit TokenStream(const std::string_view source) : mSource{ source } {}
+
+    void reserve(const size_t count) {
+        mTypes.reserve(count);
+        mLines.reserve(count);
+        mValues.reserve(count);
+    }
+
+    // Appends tokens lexed from a later part of the same source, moving their lines down
+    void append(const TokenStream &other, const int lineOffset) {
+        mTypes.insert(mTypes.end(), other.mTypes.cbegin(), other.mTypes.cend());
+        for (const int ln : other.mLines) {
+            mLines.push_back(ln + lineOffset);
+        }
+        mValues.insert(mValues.end(), other.mValues.cbegin(), other.mValues.cend());
+    }
 
-inline std::optional<int> binPrec(const TokenType &type) {
-    switch (type) {
-    case TokenType::PLUS:
-        return 0;
-    case TokenType::MINUS:
-        return 0;
-    case TokenType::STAR:
-        return 1;
-    case TokenType::FSLASH:
-        return 1;
-    default:
-        return {};
+    void clear() {
+        mTypes.clear();
+        mLines.clear();
+        mValues.clear();
     }
-}
-
-std::string to_string(const TokenType &type) {
-    switch (type) {
-    case TokenType::EXIT:
-        return "'exit'";
-    case TokenType::INT_LITERAL:
-        return "int literal";
-    case TokenType::SEMI:
-        return "';'";
-    case TokenType::OPEN_PAREN:
-        return "'('";
-    case TokenType::CLOSE_PAREN:
-        return "')'";
-    case TokenType::IDENTIFIER:
-        return "identifier";
-    case TokenType::LET:
-        return "'let'";
-    case TokenType::EQ:
-        return "'='";
-    case TokenType::PLUS:
-        return "'+'";
-    case TokenType::MINUS:
-        return "'-'";
-    case TokenType::STAR:
-        return "'*'";
-    case TokenType::FSLASH:
-        return "'/'";
-    case TokenType::OPEN_CURLY:
-        return "'{'";
-    case TokenType::CLOSE_CURLY:
-        return "'}'";
-    case TokenType::IF:
-        return "'if'";
-    case TokenType::ELIF:
-        return "'elif'";
-    case TokenType::ELSE:
-        return "'else'";
+
+    void push(const Token token) {
+        mTypes.push_back(token.type);
+        mLines.push_back(token.ln);
+        mValues.push_back(token.value);
     }
 
-    return {}; // unreachable
-}
+    [[nodiscard]] size_t size() const {
+        return mTypes.size();
+    }
 
-struct Token {
-    TokenType type{};
-    int ln{};
-    std::optional<std::string> value{};
+    [[nodiscard]] Token operator[](const size_t index) const {
+        return { .type = mTypes[index], .ln = mLines[index], .value = mValues[index] };
+    }
+
+    [[nodiscard]] std::string_view text(const Token &identifier) const {
+        return mSource.substr(identifier.value >> 32, static_cast<uint32_t>(identifier.value));
+    }
+
+    // Heap bytes held by the arrays
+    [[nodiscard]] size_t bytes() const {
+        return mTypes.capacity() * sizeof(TokenType) + mLines.capacity() * sizeof(int) + mValues.capacity() * sizeof(uint64_t);
+    }
+
+    // Same source text and the same tokens, every array compared
+    bool operator==(const TokenStream &) const = default;
+
+private:
+    std::string_view mSource{};
+    std::vector<TokenType> mTypes{};
+    std::vector<int> mLines{};
+    std::vector<uint64_t> mValues{};
 };
 
-class Tokenizer : public TextReader<std::string> {
+// Scans runs of whitespace, comments, identifiers and digits with the vector kernels the CPU
+// supports; any kernel set gives the same tokens
+class Tokenizer : public TextReader<std::string_view> {
 public:
-    Tokenizer(std::string &&src) : TextReader{ std::move(src) } {}
+    explicit Tokenizer(const std::string_view src, const ScanKernels &kernels = bestKernels()) :
+        TextReader{ std::string_view{ src } },
+        mKernels{ kernels } {
+        if (src.size() > std::numeric_limits<uint32_t>::max()) {
+            error("Source is larger than 4 GB");
+        }
+    }
 
-    std::vector<Token> tokenize() {
-        std::vector<Token> tokens{};
-        std::string buf{};
-        int lineCount{ 1 };
-        while (peek()) {
+    TokenStream tokenize() {
+        TokenStream tokens{ mTextStream };
+        tokenize(0, mTextStream.size(), tokens);
+        if (mFailure) {
+            error(*mFailure);
+        }
 
-            if (std::isalpha(*peek())) { // letter symbol
+        return tokens;
+    }
 
-                buf.push_back(consume());
-                while (peek() && std::isalnum(*peek())) { // identifier or keyword
-                    buf.push_back(consume());
+    // Appends the tokens of the source between `begin`, which must start a line, and `end`,
+    // numbering lines from `firstLine`, and returns the number of newlines passed. The first
+    // error stops it and is kept in `failure()`, so a caller lexing pieces of the source in
+    // parallel can report the one that comes first in the source.
+    int tokenize(const size_t begin, const size_t end, TokenStream &tokens, const int firstLine = 1) {
+        const char *const data{ mTextStream.data() };
+        const size_t size{ end };
+        int lineCount{ firstLine };
+        mIndex = begin;
+        while (mIndex < size && !mFailure) {
+            const char c{ data[mIndex] };
+            switch (CHAR_TABLE.classes[static_cast<uint8_t>(c)]) {
+
+            case CharClass::LETTER: { // identifier or keyword
+                const size_t start{ mIndex };
+                mIndex = mKernels.skipAlnum(data, mIndex + 1, size);
+                const std::string_view word{ mTextStream.substr(start, mIndex - start) };
+                const TokenType type{ keywordType(word) };
+                if (type == TokenType::IDENTIFIER) {
+                    tokens.push({ .type = type, .ln = lineCount, .value = uint64_t{ start } << 32 | word.size() });
+                } else {
+                    tokens.push({ .type = type, .ln = lineCount });
                 }
+                break;
+            }
 
-                if (buf == "exit") { // `exit` keyword
-                    tokens.push_back({ .type = TokenType::EXIT, .ln = lineCount });
-                } else if (buf == "let") { // `let` keyword
-                    tokens.push_back({ .type = TokenType::LET, .ln = lineCount });
-                } else if (buf == "if") { // `if` keyword
-                    tokens.push_back({ .type = TokenType::IF, .ln = lineCount });
-                } else if (buf == "elif") { // `elif` keyword
-                    tokens.push_back({ .type = TokenType::ELIF, .ln = lineCount });
-                } else if (buf == "else") { // `else` keyword
-                    tokens.push_back({ .type = TokenType::ELSE, .ln = lineCount });
-                } else { // identifier
-                    tokens.push_back({ .type = TokenType::IDENTIFIER, .ln = lineCount, .value = buf });
+            case CharClass::DIGIT: { // int literal, unsigned 64-bit
+                const size_t start{ mIndex };
+                mIndex = mKernels.skipDigits(data, mIndex + 1, size);
+                uint64_t value{};
+                bool overflow{};
+                for (size_t i{ start }; i < mIndex; ++i) {
+                    const uint64_t digit{ static_cast<uint64_t>(data[i] - '0') };
+                    overflow |= value > (std::numeric_limits<uint64_t>::max() - digit) / 10;
+                    value = value * 10 + digit;
                 }
-                buf.clear();
+                if (overflow) {
+                    mFailure = "Integer literal out of range: " + std::string{ mTextStream.substr(start, mIndex - start) };
+                }
+                tokens.push({ .type = TokenType::INT_LITERAL, .ln = lineCount, .value = value });
+                break;
+            }
 
-            } else if (std::isdigit(*peek())) { // digit
+            case CharClass::SPACE: // newlines counted
+                mIndex = mKernels.skipSpace(data, mIndex, size, lineCount);
+                break;
 
-                buf.push_back(consume());
-                while (peek() && std::isdigit(*peek())) { // int literal
-                    buf.push_back(consume());
-                }
-                tokens.push_back({ .type = TokenType::INT_LITERAL, .ln = lineCount, .value = buf });
-                buf.clear();
-
-            } else if (*peek() == '(') {
-                consume();
-                tokens.push_back({ .type = TokenType::OPEN_PAREN, .ln = lineCount });
-            } else if (*peek() == ')') {
-                consume();
-                tokens.push_back({ .type = TokenType::CLOSE_PAREN, .ln = lineCount });
-            } else if (*peek() == ';') {
-                consume();
-                tokens.push_back({ .type = TokenType::SEMI, .ln = lineCount });
-            } else if (*peek() == '=') {
-                consume();
-                tokens.push_back({ .type = TokenType::EQ, .ln = lineCount });
-            } else if (*peek() == '+') {
-                consume();
-                tokens.push_back({ .type = TokenType::PLUS, .ln = lineCount });
-            } else if (*peek() == '-') {
-                consume();
-                tokens.push_back({ .type = TokenType::MINUS, .ln = lineCount });
-            } else if (*peek() == '*') {
-                consume();
-                tokens.push_back({ .type = TokenType::STAR, .ln = lineCount });
-            } else if (*peek() == '/') {
-                consume();
-                tokens.push_back({ .type = TokenType::FSLASH, .ln = lineCount });
-            } else if (*peek() == '{') {
-                consume();
-                tokens.push_back({ .type = TokenType::OPEN_CURLY, .ln = lineCount });
-            } else if (*peek() == '}') {
-                consume();
-                tokens.push_back({ .type = TokenType::CLOSE_CURLY, .ln = lineCount });
-            } else if (*peek() == '#') { // comment
-                for (consume(); peek() && *peek() != '\n'; consume()) {} // not new line
-            } else if (*peek() == '\n') { // newline
-                consume();
-                ++lineCount;
-            } else if (std::isspace(*peek())) { // space symbol
-                consume();
-            } else {
-                error("Invalid token");
+            case CharClass::COMMENT: // up to the new line
+                mIndex = mKernels.findNewline(data, mIndex + 1, size);
+                break;
+
+            case CharClass::PUNCTUATION:
+                tokens.push({ .type = CHAR_TABLE.punctuation[static_cast<uint8_t>(c)], .ln = lineCount });
+                ++mIndex;
+                break;
+
+            case CharClass::INVALID:
+                mFailure = "Invalid token";
+                break;
             }
         }
         mIndex = 0;
 
-        return tokens;
+        return lineCount - firstLine;
+    }
+
+    [[nodiscard]] const std::optional<std::string> &failure() const {
+        return mFailure;
     }
+
+private:
+    const ScanKernels &mKernels;
+    std::optional<std::string> mFailure{};
 };
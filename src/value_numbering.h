@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint> // uint64_t
+#include <cstdlib> // size_t
+#include <functional> // std::hash
+#include <optional>
+#include <unordered_map>
+#include <utility> // std::pair, std::swap
+#include <vector>
+
+#include "ir.h"
+#include "ir_dominators.h"
+
+// Dominator-based value numbering: an instruction computing the same operation on the same
+// values as one in a dominating block, or earlier in its own block, is deleted and its uses
+// read the earlier result. So are phis of a block that merge the same values. Needs SSA
+// form, where an assignment to a variable defines a new register instead of changing the
+// values the earlier expressions were computed from.
+class ValueNumbering {
+public:
+    ValueNumbering(const ValueNumbering &) = delete;
+    ValueNumbering &operator=(const ValueNumbering &) = delete;
+
+    ValueNumbering() = default;
+
+    void run(IrFunction &fn) {
+        Dominators dominators{};
+        const DomTree tree{ dominators.analyze(fn) };
+
+        mReplacement.assign(fn.vregCount, std::nullopt);
+        mTable.clear();
+        std::vector<std::vector<Key>> inserted(fn.blocks.size()); // to forget when leaving a block
+
+        std::vector<std::pair<size_t, bool>> stack{ { 0, false } }; // block, leaving
+        while (!stack.empty()) {
+            const auto [b, leaving]{ stack.back() };
+            stack.pop_back();
+            if (leaving) {
+                for (const Key &key : inserted[b]) {
+                    mTable.erase(key);
+                }
+                continue;
+            }
+
+            IrBlock &block{ fn.blocks[b] };
+            numberPhis(block);
+            for (IrInstr &instr : block.instrs) {
+                instr.a = resolve(instr.a);
+                instr.b = resolve(instr.b);
+                if (instr.op == IrOp::COPY) {
+                    mReplacement[instr.dst] = instr.a;
+                    continue;
+                }
+
+                const Key key{ makeKey(instr) };
+                const auto [it, added]{ mTable.emplace(key, instr.dst) };
+                if (added) {
+                    inserted[b].push_back(key);
+                } else {
+                    mReplacement[instr.dst] = IrOperand::v(it->second);
+                }
+            }
+
+            stack.push_back({ b, true });
+            for (const size_t child : tree.children[b]) {
+                stack.push_back({ child, false });
+            }
+        }
+
+        // phi arguments along back edges and terminators are rewritten once all values are known
+        for (IrBlock &block : fn.blocks) {
+            std::erase_if(block.instrs, [this](const IrInstr &instr) { return mReplacement[instr.dst].has_value(); });
+            std::erase_if(block.phis, [this](const IrPhi &phi) { return mReplacement[phi.dst].has_value(); });
+            for (IrPhi &phi : block.phis) {
+                for (IrOperand &arg : phi.args) {
+                    arg = resolve(arg);
+                }
+            }
+            for (IrInstr &instr : block.instrs) {
+                instr.a = resolve(instr.a);
+                instr.b = resolve(instr.b);
+            }
+            block.term.value = resolve(block.term.value);
+        }
+    }
+
+private:
+    struct Key {
+        IrOp op{};
+        IrOperand a{};
+        IrOperand b{};
+
+        bool operator==(const Key &) const = default;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const {
+            const auto operandHash{ [](const IrOperand &operand) {
+                return std::hash<uint64_t>{}(operand.value) * 2 + (operand.isImm() ? 1 : 0);
+            } };
+            return (static_cast<size_t>(key.op) * 31 + operandHash(key.a)) * 31 + operandHash(key.b);
+        }
+    };
+
+    // Commutative operations list their operands in one order
+    static Key makeKey(const IrInstr &instr) {
+        Key key{ .op = instr.op, .a = instr.a, .b = instr.b };
+        const bool commutative{ instr.op == IrOp::ADD || instr.op == IrOp::MUL || instr.op == IrOp::MULHU };
+        if (commutative && (key.a.kind > key.b.kind || (key.a.kind == key.b.kind && key.a.value > key.b.value))) {
+            std::swap(key.a, key.b);
+        }
+        return key;
+    }
+
+    // A phi merging the same values from the same predecessors as an earlier one is redundant.
+    // Arguments along back edges may not be numbered yet, which only misses some matches.
+    void numberPhis(IrBlock &block) {
+        for (size_t i{ 0 }; i < block.phis.size(); ++i) {
+            IrPhi &phi{ block.phis[i] };
+            for (IrOperand &arg : phi.args) {
+                arg = resolve(arg);
+            }
+            for (size_t j{ 0 }; j < i; ++j) {
+                if (!mReplacement[block.phis[j].dst] && block.phis[j].args == phi.args) {
+                    mReplacement[phi.dst] = IrOperand::v(block.phis[j].dst);
+                    break;
+                }
+            }
+        }
+    }
+
+    IrOperand resolve(IrOperand operand) const {
+        while (operand.isVreg() && mReplacement[operand.vreg()]) {
+            operand = *mReplacement[operand.vreg()];
+        }
+        return operand;
+    }
+
+    std::vector<std::optional<IrOperand>> mReplacement{};
+    std::unordered_map<Key, Vreg, KeyHash> mTable{};
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef> // size_t
+#include <cstdint> // int64_t, uint8_t
+#include <string>
+#include <vector>
+
+// Register numbers match the x86-64 encoding (low 3 bits + REX extension bit)
+enum class Reg : uint8_t {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+inline std::string to_string(const Reg &reg) {
+    static constexpr const char *NAMES[]{
+        "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+        "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+    };
+    return NAMES[static_cast<size_t>(reg)];
+}
+
+struct Operand {
+    enum class Kind { NONE, REG, IMM, MEM, LABEL };
+
+    Kind kind{};
+    Reg reg{}; // register, or base register of a memory operand
+    Reg index{}; // index register of a memory operand, if `scale` is nonzero
+    uint8_t scale{}; // 1, 2, 4 or 8
+    int64_t imm{}; // immediate, or displacement of a memory operand
+    size_t label{};
+
+    [[nodiscard]] static Operand r(const Reg reg) {
+        return { .kind = Kind::REG, .reg = reg };
+    }
+
+    [[nodiscard]] static Operand i(const int64_t imm) {
+        return { .kind = Kind::IMM, .imm = imm };
+    }
+
+    // QWORD [base + disp]
+    [[nodiscard]] static Operand mem(const Reg base, const int64_t disp) {
+        return { .kind = Kind::MEM, .reg = base, .imm = disp };
+    }
+
+    // QWORD [base + index * scale + disp]
+    [[nodiscard]] static Operand mem(const Reg base, const Reg index, const uint8_t scale, const int64_t disp = 0) {
+        return { .kind = Kind::MEM, .reg = base, .index = index, .scale = scale, .imm = disp };
+    }
+
+    [[nodiscard]] static Operand lbl(const size_t label) {
+        return { .kind = Kind::LABEL, .label = label };
+    }
+
+    [[nodiscard]] bool isReg(const Reg other) const { return kind == Kind::REG && reg == other; }
+
+    // Whether the operand is the register or addresses memory through it
+    [[nodiscard]] bool mentions(const Reg other) const {
+        return ((kind == Kind::REG || kind == Kind::MEM) && reg == other) || (kind == Kind::MEM && scale != 0 && index == other);
+    }
+
+    bool operator==(const Operand &) const = default;
+};
+
+enum class Op {
+    MOV, LEA, PUSH, POP, ADD, SUB, MUL, IMUL, DIV, XOR, SHL, SHR, CMP, TEST, JMP, JZ, JNZ, SYSCALL, RET,
+    LABEL, COMMENT, LINE, // pseudo instructions; `LINE` starts the code of the source line in `dst`
+};
+
+struct Instr {
+    Op op{};
+    Operand dst{};
+    Operand src{};
+    Operand src2{}; // immediate of the three-operand `imul`
+    std::string text{}; // comment text
+};
+
+using InstrList = std::vector<Instr>;
+
+inline std::string labelName(const size_t label) {
+    return "label" + std::to_string(label);
+}
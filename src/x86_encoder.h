@@ -0,0 +1,358 @@
+#pragma once
+
+#include <bit> // std::countr_zero
+#include <cstddef> // size_t
+#include <cstdint> // int32_t, int64_t, uint8_t
+#include <limits>
+#include <vector>
+
+#include "line_table.h"
+#include "not_implemented_error.h"
+#include "x86.h"
+
+// Encodes an instruction list into x86-64 machine code
+class X86Encoder {
+public:
+    X86Encoder(const X86Encoder &) = delete;
+    X86Encoder &operator=(const X86Encoder &) = delete;
+
+    X86Encoder() = default;
+
+    [[nodiscard]] std::vector<uint8_t> encode(const InstrList &instrs) {
+        for (const Instr &instr : instrs) {
+            encodeInstr(instr);
+        }
+
+        for (const Fixup &fixup : mFixups) {
+            const int64_t rel{
+                static_cast<int64_t>(mLabels[fixup.label]) - static_cast<int64_t>(fixup.pos + sizeof(int32_t))
+            };
+            patch32(fixup.pos, static_cast<int32_t>(rel));
+        }
+
+        return mCode;
+    }
+
+    // Where the code of each source line starts, in the order of the code
+    [[nodiscard]] const std::vector<LineEntry> &lines() const {
+        return mLines;
+    }
+
+private:
+    struct Fixup {
+        size_t pos{}; // position of the rel32 field
+        size_t label{};
+    };
+
+    static constexpr uint8_t REX{ 0x40 };
+    static constexpr uint8_t REX_W{ 0x08 };
+    static constexpr uint8_t MODRM_REG{ 0xc0 };
+    static constexpr uint8_t SIB_RSP{ 0x24 };
+
+    static uint8_t num(const Reg reg) { return static_cast<uint8_t>(reg); }
+
+    static bool fitsInt8(const int64_t value) {
+        return value >= std::numeric_limits<int8_t>::min() && value <= std::numeric_limits<int8_t>::max();
+    }
+
+    static bool fitsInt32(const int64_t value) {
+        return value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max();
+    }
+
+    static bool fitsUint32(const int64_t value) {
+        return value >= 0 && value <= std::numeric_limits<uint32_t>::max();
+    }
+
+    void encodeInstr(const Instr &instr) {
+        const Operand &dst{ instr.dst };
+        const Operand &src{ instr.src };
+
+        switch (instr.op) {
+        case Op::MOV:
+            if (dst.kind == Operand::Kind::REG && src.kind == Operand::Kind::IMM) {
+                movImm(dst.reg, src.imm);
+            } else if (dst.kind == Operand::Kind::REG && src.kind == Operand::Kind::MEM) {
+                rm(0x8b, num(dst.reg), src);
+            } else if (src.kind == Operand::Kind::REG) {
+                rm(0x89, num(src.reg), dst);
+            } else if (dst.kind == Operand::Kind::MEM && src.kind == Operand::Kind::IMM && fitsInt32(src.imm)) {
+                rm(0xc7, 0, dst);
+                emit32(static_cast<int32_t>(src.imm));
+            } else {
+                throw NotImplementedError{};
+            }
+            return;
+
+        case Op::LEA:
+            if (dst.kind != Operand::Kind::REG || src.kind != Operand::Kind::MEM) {
+                throw NotImplementedError{};
+            }
+            rm(0x8d, num(dst.reg), src);
+            return;
+
+        case Op::PUSH:
+            if (dst.kind == Operand::Kind::REG) {
+                rex(false, 0, num(dst.reg));
+                emit(0x50 + (num(dst.reg) & 7));
+            } else if (dst.kind == Operand::Kind::MEM) {
+                rm(0xff, 6, dst, false);
+            } else {
+                throw NotImplementedError{};
+            }
+            return;
+
+        case Op::POP:
+            if (dst.kind == Operand::Kind::REG) {
+                rex(false, 0, num(dst.reg));
+                emit(0x58 + (num(dst.reg) & 7));
+            } else if (dst.kind == Operand::Kind::MEM) {
+                rm(0x8f, 0, dst, false);
+            } else {
+                throw NotImplementedError{};
+            }
+            return;
+
+        case Op::ADD:
+            alu(0x00, 0, dst, src);
+            return;
+
+        case Op::SUB:
+            alu(0x28, 5, dst, src);
+            return;
+
+        case Op::MUL:
+            rm(0xf7, 4, dst);
+            return;
+
+        case Op::IMUL:
+            if (dst.kind != Operand::Kind::REG) {
+                throw NotImplementedError{};
+            }
+            if (instr.src2.kind == Operand::Kind::IMM) { // imul r, r/m, imm
+                const bool short8{ fitsInt8(instr.src2.imm) };
+                rm(short8 ? 0x6b : 0x69, num(dst.reg), src);
+                if (short8) {
+                    emit(static_cast<uint8_t>(instr.src2.imm));
+                } else if (fitsInt32(instr.src2.imm)) {
+                    emit32(static_cast<int32_t>(instr.src2.imm));
+                } else {
+                    throw NotImplementedError{};
+                }
+                return;
+            }
+            rex(true, num(dst.reg), src);
+            emit(0x0f);
+            emit(0xaf);
+            modrm(num(dst.reg), src);
+            return;
+
+        case Op::DIV:
+            rm(0xf7, 6, dst);
+            return;
+
+        case Op::XOR:
+            alu(0x30, 6, dst, src);
+            return;
+
+        case Op::SHL:
+            shift(4, dst, src);
+            return;
+
+        case Op::SHR:
+            shift(5, dst, src);
+            return;
+
+        case Op::CMP:
+            alu(0x38, 7, dst, src);
+            return;
+
+        case Op::TEST:
+            if (src.kind != Operand::Kind::REG) {
+                throw NotImplementedError{};
+            }
+            rm(0x85, num(src.reg), dst);
+            return;
+
+        case Op::JMP:
+            emit(0xe9);
+            rel32(dst.label);
+            return;
+
+        case Op::JZ:
+            emit(0x0f);
+            emit(0x84);
+            rel32(dst.label);
+            return;
+
+        case Op::JNZ:
+            emit(0x0f);
+            emit(0x85);
+            rel32(dst.label);
+            return;
+
+        case Op::SYSCALL:
+            emit(0x0f);
+            emit(0x05);
+            return;
+
+        case Op::RET:
+            emit(0xc3);
+            return;
+
+        case Op::LABEL:
+            if (mLabels.size() <= dst.label) {
+                mLabels.resize(dst.label + 1);
+            }
+            mLabels[dst.label] = mCode.size();
+            return;
+
+        case Op::COMMENT:
+            return;
+
+        case Op::LINE:
+            mLines.push_back({ .offset = mCode.size(), .line = static_cast<int>(dst.imm) });
+            return;
+        }
+    }
+
+    void movImm(const Reg reg, const int64_t imm) {
+        if (fitsUint32(imm)) { // mov r32, imm32 zero-extends
+            rex(false, 0, num(reg));
+            emit(0xb8 + (num(reg) & 7));
+            emit32(static_cast<int32_t>(static_cast<uint32_t>(imm)));
+        } else if (fitsInt32(imm)) { // sign-extended imm32
+            rm(0xc7, 0, Operand::r(reg));
+            emit32(static_cast<int32_t>(imm));
+        } else { // movabs
+            rex(true, 0, num(reg));
+            emit(0xb8 + (num(reg) & 7));
+            emit64(imm);
+        }
+    }
+
+    // Two-operand ALU instruction (`opBase` is the `r/m, r` opcode, `ext` the /digit of the immediate form)
+    void alu(const uint8_t opBase, const uint8_t ext, const Operand &dst, const Operand &src) {
+        if (src.kind == Operand::Kind::REG) {
+            rm(opBase + 1, num(src.reg), dst);
+        } else if (dst.kind == Operand::Kind::REG && src.kind == Operand::Kind::MEM) {
+            rm(opBase + 3, num(dst.reg), src);
+        } else if (src.kind == Operand::Kind::IMM && fitsInt8(src.imm)) {
+            rm(0x83, ext, dst);
+            emit(static_cast<uint8_t>(src.imm));
+        } else if (src.kind == Operand::Kind::IMM && fitsInt32(src.imm)) {
+            rm(0x81, ext, dst);
+            emit32(static_cast<int32_t>(src.imm));
+        } else {
+            throw NotImplementedError{};
+        }
+    }
+
+    // Shift by an immediate count (`ext` is the /digit of `shl`/`shr`)
+    void shift(const uint8_t ext, const Operand &dst, const Operand &src) {
+        if (src.kind != Operand::Kind::IMM || src.imm < 0 || src.imm > 63) {
+            throw NotImplementedError{};
+        }
+        if (src.imm == 1) { // no count byte
+            rm(0xd1, ext, dst);
+            return;
+        }
+        rm(0xc1, ext, dst);
+        emit(static_cast<uint8_t>(src.imm));
+    }
+
+    // Opcode with a ModRM byte: `regField` is a register number or an opcode extension
+    void rm(const uint8_t opcode, const uint8_t regField, const Operand &rmOp, const bool wide = true) {
+        rex(wide, regField, rmOp);
+        emit(opcode);
+        modrm(regField, rmOp);
+    }
+
+    // REX prefix for a ModRM operand, extending its base and index registers
+    void rex(const bool wide, const uint8_t reg, const Operand &rmOp) {
+        const bool indexed{ rmOp.kind == Operand::Kind::MEM && rmOp.scale != 0 };
+        rex(wide, reg, num(rmOp.reg), indexed ? num(rmOp.index) : 0);
+    }
+
+    void rex(const bool wide, const uint8_t reg, const uint8_t base, const uint8_t index = 0) {
+        const uint8_t prefix{
+            static_cast<uint8_t>(REX | (wide ? REX_W : 0) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3))
+        };
+        if (prefix != REX) {
+            emit(prefix);
+        }
+    }
+
+    void modrm(const uint8_t regField, const Operand &rmOp) {
+        const uint8_t regBits{ static_cast<uint8_t>((regField & 7) << 3) };
+        const uint8_t base{ static_cast<uint8_t>(num(rmOp.reg) & 7) };
+
+        if (rmOp.kind == Operand::Kind::REG) {
+            emit(MODRM_REG | regBits | base);
+            return;
+        }
+        if (rmOp.kind != Operand::Kind::MEM) {
+            throw NotImplementedError{};
+        }
+
+        const int64_t disp{ rmOp.imm };
+        constexpr uint8_t RBP_LOW{ 5 }; // rbp/r13 with mod 00 means rip-relative
+        constexpr uint8_t RSP_LOW{ 4 }; // rsp/r12 as base requires a SIB byte
+
+        uint8_t mod{};
+        if (disp == 0 && base != RBP_LOW) {
+            mod = 0x00;
+        } else if (fitsInt8(disp)) {
+            mod = 0x40;
+        } else {
+            mod = 0x80;
+        }
+
+        if (rmOp.scale != 0) { // SIB byte with an index
+            const uint8_t scaleBits{ static_cast<uint8_t>(std::countr_zero(rmOp.scale) << 6) };
+            emit(mod | regBits | RSP_LOW);
+            emit(scaleBits | static_cast<uint8_t>((num(rmOp.index) & 7) << 3) | base);
+        } else {
+            emit(mod | regBits | base);
+            if (base == RSP_LOW) {
+                emit(SIB_RSP);
+            }
+        }
+        if (mod == 0x40) {
+            emit(static_cast<uint8_t>(disp));
+        } else if (mod == 0x80) {
+            emit32(static_cast<int32_t>(disp));
+        }
+    }
+
+    void rel32(const size_t label) {
+        mFixups.push_back({ .pos = mCode.size(), .label = label });
+        emit32(0);
+    }
+
+    void emit(const uint8_t byte) {
+        mCode.push_back(byte);
+    }
+
+    void emit32(const int32_t value) {
+        for (size_t i{ 0 }; i < sizeof(value); ++i) {
+            emit(static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * i)));
+        }
+    }
+
+    void emit64(const int64_t value) {
+        for (size_t i{ 0 }; i < sizeof(value); ++i) {
+            emit(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+        }
+    }
+
+    void patch32(const size_t pos, const int32_t value) {
+        for (size_t i{ 0 }; i < sizeof(value); ++i) {
+            mCode[pos + i] = static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8 * i));
+        }
+    }
+
+    std::vector<uint8_t> mCode{};
+    std::vector<LineEntry> mLines{};
+    std::vector<size_t> mLabels{};
+    std::vector<Fixup> mFixups{};
+};